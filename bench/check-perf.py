@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+#
+#  check-perf.py - compare run-bench.py timings with a stored baseline
+#
+#  The baseline is a CSV of installed,operation,median_ms. Every case of
+#  it is timed again with run-bench.py --aur (generated databases and
+#  mock-aur.py, nothing leaves the machine) and the check fails when a
+#  median is more than --tolerance slower than the baseline one.
+#  Differences under --min-ms are not reported, they are mostly noise.
+#
+#  Timings depend on the machine: record the baseline on the one running
+#  the check, with --update. The cases are then read from --cases (the
+#  list in the tree, bench/perf-baseline.csv, by default) and written
+#  with their times to --baseline. A case without a baseline time fails
+#  the check.
+#
+#  usage: check-perf.py --binary src/package-query [--baseline FILE]
+#                       [--tolerance 0.10] [--min-ms 2] [--runs 5]
+#                       [--update [--cases FILE]]
+#
+import argparse
+import csv
+import io
+import os
+import subprocess
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+HEADER = """\
+# package-query performance baseline, see bench/check-perf.py
+# recorded with make perf-baseline, valid on this machine only
+"""
+
+
+def read_baseline(path):
+    """{(installed, operation): median_ms or None}, in file order"""
+    cases = {}
+    with open(path) as f:
+        rows = csv.DictReader(line for line in f if not line.startswith("#"))
+        for row in rows:
+            median = row["median_ms"].strip()
+            cases[(int(row["installed"]), row["operation"])] = \
+                float(median) if median else None
+    return cases
+
+
+def write_baseline(path, cases, results):
+    with open(path, "w") as f:
+        f.write(HEADER)
+        out = csv.writer(f)
+        out.writerow(["installed", "operation", "median_ms"])
+        for key in cases:
+            res = results.get(key)
+            out.writerow([key[0], key[1], res["median_ms"] if res else ""])
+
+
+def run_bench(args, cases):
+    sizes = sorted({size for size, _ in cases})
+    ops = sorted({op for _, op in cases})
+    cmd = [sys.executable, os.path.join(HERE, "run-bench.py"),
+           "--binary", args.binary, "--aur", "--runs", str(args.runs),
+           "--sizes", ",".join(str(s) for s in sizes), "--only", ",".join(ops)]
+    if args.keep:
+        cmd += ["--keep", args.keep]
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE, text=True, check=True)
+    return {(int(row["installed"]), row["operation"]): row
+            for row in csv.DictReader(io.StringIO(proc.stdout))}
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", required=True)
+    parser.add_argument("--baseline", default=os.path.join(HERE, "perf-baseline.csv"))
+    parser.add_argument("--cases", default=os.path.join(HERE, "perf-baseline.csv"),
+                        help="cases recorded by --update")
+    parser.add_argument("--tolerance", type=float, default=0.10,
+                        help="allowed slowdown, 0.10 for 10%%")
+    parser.add_argument("--min-ms", type=float, default=2,
+                        help="ignore differences smaller than this")
+    parser.add_argument("--runs", type=int, default=5)
+    parser.add_argument("--keep", help="keep the databases in this directory")
+    parser.add_argument("--update", action="store_true",
+                        help="write the new timings to the baseline")
+    args = parser.parse_args()
+
+    source = args.cases if args.update else args.baseline
+    if not os.path.exists(source):
+        sys.exit("%s: no baseline, run make perf-baseline first" % source)
+    cases = read_baseline(source)
+    if not cases:
+        sys.exit("%s: no case" % source)
+    if not args.update and all(base is None for base in cases.values()):
+        sys.exit("%s: no baseline time, run make perf-baseline first" % source)
+    results = run_bench(args, cases)
+
+    if args.update:
+        write_baseline(args.baseline, cases, results)
+        print("%s: %d cases recorded" % (args.baseline, len(results)))
+        return
+
+    failed = 0
+    for key, base in cases.items():
+        name = "%s @%d" % (key[1], key[0])
+        res = results.get(key)
+        if not res or res["status"] != "ok" or not res["median_ms"]:
+            print("FAIL %-28s %s" % (name, res["status"] if res else "not run"))
+            failed += 1
+            continue
+        median = float(res["median_ms"])
+        if base is None:
+            print("FAIL %-28s %10.3f ms  no baseline time, run make perf-baseline"
+                  % (name, median))
+            failed += 1
+            continue
+        ratio = median / base if base > 0 else float("inf")
+        slower = ratio > 1 + args.tolerance and median - base >= args.min_ms
+        print("%s %-28s %10.3f ms  baseline %10.3f ms  x%.2f"
+              % ("FAIL" if slower else "ok  ", name, median, base, ratio))
+        failed += slower
+
+    if failed:
+        print("%d of %d cases failed (tolerance +%g%%)"
+              % (failed, len(cases), args.tolerance * 100))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,157 @@
+#!/usr/bin/env python3
+#
+#  check-scaling.py - check that worst case inputs scale sub-quadratically
+#
+#  Each case is timed at doubling input sizes, and the exponent of the
+#  time against the size is fitted on a log-log scale: about 1 for a
+#  linear path, 2 for a quadratic one. The check fails when an exponent
+#  is over --max-exponent.
+#
+#  The string distances compare a name and a pattern both growing with
+#  the size, they are O(n * m) whatever the implementation: the plain
+#  dynamic programming is n * m, the bit-parallel one n * m / 64. The
+#  exponent can't tell them apart, so these cases are timed against the
+#  dynamic programming reference (big_*_dp) instead, and fail when they
+#  are not under --max-dp-ratio of its time.
+#
+#  Cases:
+#    big_lcs, big_levenshtein   long names against long patterns
+#    big_string_ncat            long outputs built a few bytes at a time
+#    big_response_parse         RPC replies with many results, reverse order
+#    big_target_arg_clear       many targets, all found, reverse order
+#    realsize                   %3 of a package owning many files, on a
+#                               database from gen-pacman-db.py --big-package
+#
+#  usage: check-scaling.py --micro-bench src/micro-bench
+#                          [--binary src/package-query]
+#                          [--max-exponent 1.5] [--max-dp-ratio 0.25]
+#                          [--keep DIR]
+#
+import argparse
+import math
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+MICRO_CASES = ["big_string_ncat", "big_response_parse", "big_target_arg_clear"]
+DP_CASES = ["big_lcs", "big_levenshtein"]
+
+
+def exponent(sizes, times):
+    """Least squares slope of log(time) against log(size)"""
+    xs = [math.log(s) for s in sizes]
+    ys = [math.log(max(t, 1e-9)) for t in times]
+    mx, my = statistics.mean(xs), statistics.mean(ys)
+    return (sum((x - mx) * (y - my) for x, y in zip(xs, ys))
+            / sum((x - mx) ** 2 for x in xs))
+
+
+def micro_time(args, case, size):
+    """Median ns per call of a micro-bench kernel"""
+    out = subprocess.run([args.micro_bench, "-w", "1", "-r", str(args.runs),
+                          "-k", case, "-n", str(size)],
+                         stdout=subprocess.PIPE, text=True, check=True).stdout
+    for line in out.splitlines():
+        fields = line.split()
+        if fields and fields[0] == case:
+            return float(fields[3])
+    sys.exit("%s: no result for %s" % (args.micro_bench, case))
+
+
+def wall_time(cmd, runs):
+    times = []
+    for _ in range(runs):
+        start = time.perf_counter()
+        subprocess.run(cmd, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        times.append(time.perf_counter() - start)
+    return statistics.median(times)
+
+
+def realsize_time(args, base, size):
+    """%3 of big-package, minus the same query without %3"""
+    d = os.path.join(base, "realsize-%d" % size)
+    if not os.path.exists(os.path.join(d, "pacman.conf")):
+        subprocess.run([sys.executable, os.path.join(HERE, "gen-pacman-db.py"),
+                        "--installed", "10", "--repos", "1", "--repo-size", "10",
+                        "--files", "1", "--create-files", "--big-package", str(size), d],
+                       check=True)
+    common = [args.binary, "--nocolor", "-c", os.path.join(d, "pacman.conf"),
+              "-b", os.path.join(d, "db"), "-r", os.path.join(d, "root"), "-Q"]
+    full = wall_time(common + ["-f", "%n %3", "big-package"], args.runs)
+    control = wall_time(common + ["-f", "%n", "big-package"], args.runs)
+    return max(full - control, 1e-6) * 1e9
+
+
+def check(name, sizes, timer, max_exponent):
+    times = [timer(s) for s in sizes]
+    e = exponent(sizes, times)
+    ok = e <= max_exponent
+    print("%s %-22s exponent %5.2f  %s" % ("ok  " if ok else "FAIL", name, e,
+          "  ".join("%d:%.0fus" % (s, t / 1e3) for s, t in zip(sizes, times))))
+    sys.stdout.flush()
+    return ok
+
+
+def check_dp(args, name, sizes):
+    """name against its dynamic programming reference, at each size"""
+    ratios = []
+    for s in sizes:
+        ratios.append(micro_time(args, name, s) / micro_time(args, name + "_dp", s))
+    ok = max(ratios) <= args.max_dp_ratio
+    print("%s %-22s dp ratio %5.3f  %s" % ("ok  " if ok else "FAIL", name, max(ratios),
+          "  ".join("%d:%.3f" % (s, r) for s, r in zip(sizes, ratios))))
+    sys.stdout.flush()
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--micro-bench", required=True)
+    parser.add_argument("--binary", help="package-query, for the realsize case")
+    parser.add_argument("--sizes", default="4096,8192,16384,32768,65536",
+                        help="input sizes of the micro-bench cases")
+    parser.add_argument("--name-sizes", default="256,512,1024,2048,4096",
+                        help="name and pattern lengths of the distance cases")
+    parser.add_argument("--file-sizes", default="4000,8000,16000,32000",
+                        help="files of big-package for the realsize case")
+    parser.add_argument("--max-exponent", type=float, default=1.5)
+    parser.add_argument("--max-dp-ratio", type=float, default=0.25,
+                        help="time of the distances over their reference")
+    parser.add_argument("--runs", type=int, default=5)
+    parser.add_argument("--only", help="comma separated case names")
+    parser.add_argument("--keep", help="keep the databases in this directory")
+    args = parser.parse_args()
+
+    only = set(args.only.split(",")) if args.only else None
+    sizes = [int(s) for s in args.sizes.split(",")]
+    failed = 0
+    name_sizes = [int(s) for s in args.name_sizes.split(",")]
+    for case in DP_CASES:
+        if not only or case in only:
+            failed += not check_dp(args, case, name_sizes)
+    for case in MICRO_CASES:
+        if not only or case in only:
+            failed += not check(case, sizes,
+                                lambda n: micro_time(args, case, n), args.max_exponent)
+
+    if args.binary and (not only or "realsize" in only):
+        tmp = None if args.keep else tempfile.TemporaryDirectory(prefix="pq-scaling-")
+        base = args.keep or tmp.name
+        file_sizes = [int(s) for s in args.file_sizes.split(",")]
+        failed += not check("realsize", file_sizes,
+                            lambda n: realsize_time(args, base, n), args.max_exponent)
+        if tmp:
+            tmp.cleanup()
+
+    if failed:
+        print("%d cases failed" % failed)
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
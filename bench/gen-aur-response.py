@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+#
+#  gen-aur-response.py - write synthetic AUR RPC v5 responses
+#
+#  Used as input for json-bench and the other benchmarks, the output is
+#  deterministic for a given seed.
+#
+#  usage: gen-aur-response.py [--type search|info] [--count N] [--seed S]
+#
+import argparse
+import json
+import random
+import sys
+
+WORDS = ["lib", "python", "git", "qt", "gtk", "rust", "bin", "font", "theme",
+         "kernel", "driver", "utils", "daemon", "client", "server", "tool"]
+DESC = ["A", "fast", "small", "library", "for", "handling", "files", "with",
+        "support", "of", "UTF-8", "names", "ünïcödé", "and", "\"quotes\"",
+        "back\\slashes", "tabs\there", "emoji \U0001F600"]
+LICENSES = ["GPL", "GPL3", "MIT", "BSD", "Apache", "custom"]
+
+
+def name(rnd):
+    return "-".join(rnd.choice(WORDS) for _ in range(rnd.randint(1, 3))) \
+        + str(rnd.randint(0, 999))
+
+
+def package(rnd, i, info):
+    pkg_name = name(rnd)
+    pkg = {
+        "ID": 100000 + i,
+        "Name": pkg_name,
+        "PackageBaseID": 50000 + i,
+        "PackageBase": pkg_name,
+        "Version": "%d.%d.%d-%d" % (rnd.randint(0, 20), rnd.randint(0, 99),
+                                    rnd.randint(0, 99), rnd.randint(1, 5)),
+        "Description": " ".join(rnd.choice(DESC)
+                                for _ in range(rnd.randint(3, 20))),
+        "URL": "https://example.org/" + pkg_name,
+        "NumVotes": rnd.randint(0, 3000),
+        "Popularity": round(rnd.expovariate(1.0) * rnd.choice([1, 1e-3, 10]), 6),
+        "OutOfDate": rnd.choice([None, None, None, rnd.randint(1200000000, 1700000000)]),
+        "Maintainer": rnd.choice([None, "maint" + str(rnd.randint(0, 500))]),
+        "FirstSubmitted": rnd.randint(1200000000, 1600000000),
+        "LastModified": rnd.randint(1600000000, 1700000000),
+        "URLPath": "/cgit/aur.git/snapshot/%s.tar.gz" % pkg_name,
+    }
+    if info:
+        for key in ("Depends", "MakeDepends", "OptDepends", "CheckDepends",
+                    "Conflicts", "Provides", "Replaces", "Groups", "Keywords"):
+            if rnd.random() < 0.6:
+                pkg[key] = [name(rnd) + rnd.choice(["", ">=1.0", "<2"])
+                            for _ in range(rnd.randint(1, 12))]
+        pkg["License"] = rnd.sample(LICENSES, rnd.randint(1, 2))
+    return pkg
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--type", choices=["search", "info"], default="search")
+    parser.add_argument("--count", type=int, default=5000)
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    rnd = random.Random(args.seed)
+    results = [package(rnd, i, args.type == "info") for i in range(args.count)]
+    json.dump({"version": 5, "type": args.type, "resultcount": len(results),
+               "results": results}, sys.stdout, separators=(",", ":"))
+
+
+if __name__ == "__main__":
+    main()
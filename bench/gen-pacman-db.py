@@ -0,0 +1,227 @@
+#!/usr/bin/env python3
+#
+#  gen-pacman-db.py - write a synthetic pacman root and database
+#
+#  Creates in DIR:
+#    root/                 root directory (-r), with the files of the
+#                          installed packages when --create-files is given
+#    db/local/             N installed packages
+#    db/sync/repoK.db      M sync repositories
+#    pacman.conf           to be given with -c
+#    manifest.json         some names and provides, for the benchmarks
+#
+#  Most installed packages come from the sync repositories, some with an
+#  older version (-Qu), the others are foreign (-Qm). The output is
+#  deterministic for a given seed.
+#
+#  --big-package F adds a foreign package named big-package owning F
+#  files, with --create-files the worst case of the real size (%3).
+#
+#  usage: gen-pacman-db.py [--installed N] [--repos M] [--repo-size S]
+#                          [--deps D] [--files F] [--big-package F]
+#                          [--seed S] DIR
+#
+import argparse
+import io
+import json
+import os
+import random
+import tarfile
+
+WORDS = ["lib", "python", "git", "qt", "gtk", "rust", "bin", "font", "theme",
+         "kernel", "driver", "utils", "daemon", "client", "server", "tool"]
+DESC = ["A", "fast", "small", "library", "for", "handling", "files", "with",
+        "support", "of", "UTF-8", "names", "and", "plugins", "bindings"]
+LICENSES = ["GPL", "GPL3", "MIT", "BSD", "Apache", "custom"]
+GROUPS = ["base-devel", "xorg", "gnome", "kde", "texlive"]
+
+
+def entry(key, values):
+    """One %KEY% section of a desc file"""
+    if not isinstance(values, list):
+        values = [values]
+    if not values:
+        return ""
+    return "%%%s%%\n%s\n\n" % (key, "\n".join(str(v) for v in values))
+
+
+class Package:
+    def __init__(self, rnd, name, repo):
+        self.name = name
+        self.repo = repo
+        self.version = "%d.%d.%d-%d" % (rnd.randint(1, 20), rnd.randint(0, 99),
+                                        rnd.randint(0, 99), rnd.randint(1, 5))
+        self.desc = " ".join(rnd.choice(DESC) for _ in range(rnd.randint(3, 12)))
+        self.size = rnd.randint(1024, 200 * 1024 * 1024)
+        self.builddate = rnd.randint(1500000000, 1700000000)
+        self.licenses = rnd.sample(LICENSES, rnd.randint(1, 2))
+        self.groups = [rnd.choice(GROUPS)] if rnd.random() < 0.1 else []
+        self.depends = []
+        self.optdepends = []
+        self.provides = []
+        self.files = []
+
+    def desc_common(self):
+        return (entry("NAME", self.name) + entry("VERSION", self.version)
+                + entry("BASE", self.name) + entry("DESC", self.desc)
+                + entry("GROUPS", self.groups)
+                + entry("URL", "https://example.org/" + self.name)
+                + entry("LICENSE", self.licenses) + entry("ARCH", "x86_64")
+                + entry("BUILDDATE", self.builddate)
+                + entry("PACKAGER", "Bench <bench@example.org>"))
+
+    def deps_desc(self):
+        return (entry("DEPENDS", self.depends)
+                + entry("OPTDEPENDS", self.optdepends)
+                + entry("PROVIDES", self.provides))
+
+
+def sync_desc(pkg):
+    filename = "%s-%s-x86_64.pkg.tar.zst" % (pkg.name, pkg.version)
+    return (entry("FILENAME", filename) + pkg.desc_common()
+            + entry("CSIZE", pkg.size // 3) + entry("ISIZE", pkg.size)
+            + entry("SHA256SUM", "0" * 64) + pkg.deps_desc())
+
+
+def local_desc(pkg, explicit, installdate):
+    return (pkg.desc_common() + entry("INSTALLDATE", installdate)
+            + entry("SIZE", pkg.size)
+            + ("" if explicit else entry("REASON", 1))
+            + entry("VALIDATION", "none") + pkg.deps_desc())
+
+
+def local_files(pkg):
+    dirs = sorted({os.path.dirname(f) + "/" for f in pkg.files})
+    return entry("FILES", ["usr/"] + dirs + pkg.files)
+
+
+def pick_deps(rnd, pkgs, pkg, count):
+    """count dependencies among pkgs, with a version constraint sometimes"""
+    deps = set()
+    for _ in range(count):
+        dep = rnd.choice(pkgs)
+        if dep is not pkg:
+            deps.add(dep.name + rnd.choice(["", "", "", ">=1.0"]))
+    return sorted(deps)
+
+
+def write_sync_db(path, pkgs):
+    with tarfile.open(path, "w:gz") as tar:
+        for pkg in pkgs:
+            pkgdir = "%s-%s" % (pkg.name, pkg.version)
+            info = tarfile.TarInfo(pkgdir)
+            info.type = tarfile.DIRTYPE
+            info.mode = 0o755
+            tar.addfile(info)
+            data = sync_desc(pkg).encode()
+            info = tarfile.TarInfo(pkgdir + "/desc")
+            info.size = len(data)
+            info.mode = 0o644
+            tar.addfile(info, io.BytesIO(data))
+
+
+def write_file(path, data):
+    with open(path, "w") as f:
+        f.write(data)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--installed", type=int, default=1000)
+    parser.add_argument("--repos", type=int, default=4)
+    parser.add_argument("--repo-size", type=int, default=2000)
+    parser.add_argument("--deps", type=float, default=3,
+                        help="average number of dependencies per package")
+    parser.add_argument("--files", type=int, default=20,
+                        help="average number of files per installed package")
+    parser.add_argument("--foreign", type=float, default=0.1)
+    parser.add_argument("--outdated", type=float, default=0.1)
+    parser.add_argument("--explicit", type=float, default=0.3)
+    parser.add_argument("--big-package", type=int, default=0,
+                        help="files of an extra package named big-package")
+    parser.add_argument("--create-files", action="store_true",
+                        help="create the installed files under root/")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("dir")
+    args = parser.parse_args()
+
+    rnd = random.Random(args.seed)
+    root = os.path.join(args.dir, "root")
+    dbpath = os.path.join(args.dir, "db")
+    os.makedirs(os.path.join(dbpath, "local"), exist_ok=True)
+    os.makedirs(os.path.join(dbpath, "sync"), exist_ok=True)
+    os.makedirs(root, exist_ok=True)
+
+    def name(i):
+        return "%s-%s%d" % (rnd.choice(WORDS), rnd.choice(WORDS), i)
+
+    repos = ["repo%d" % k for k in range(args.repos)]
+    sync = [Package(rnd, name(i), repos[i % args.repos])
+            for i in range(args.repos * args.repo_size)]
+    provides = ["virtual%d" % i for i in range(max(1, len(sync) // 50))]
+    for pkg in sync:
+        pkg.depends = pick_deps(rnd, sync, pkg, rnd.randint(0, int(2 * args.deps)))
+        if rnd.random() < 0.05:
+            pkg.provides = [rnd.choice(provides)]
+
+    n_sync = min(len(sync), int(args.installed * (1 - args.foreign)))
+    installed = []
+    for pkg in rnd.sample(sync, n_sync):
+        local = Package(rnd, pkg.name, None)
+        local.__dict__.update({k: v for k, v in pkg.__dict__.items()
+                               if k not in ("repo", "files", "depends")})
+        if rnd.random() < args.outdated:
+            local.version = "0." + pkg.version
+        installed.append(local)
+    installed += [Package(rnd, "foreign-" + name(i), None)
+                  for i in range(args.installed - n_sync)]
+    for pkg in installed:
+        pkg.depends = pick_deps(rnd, installed, pkg,
+                                rnd.randint(0, int(2 * args.deps)))
+        if rnd.random() < 0.2:
+            pkg.optdepends = [d + ": optional" for d in
+                              pick_deps(rnd, installed, pkg, 2)]
+        pkg.files = ["usr/share/%s/file%d" % (pkg.name, i)
+                     for i in range(rnd.randint(1, max(1, 2 * args.files)))]
+    if args.big_package:
+        big = Package(rnd, "big-package", None)
+        big.files = ["usr/share/big-package/%d/file%d" % (i // 1000, i)
+                     for i in range(args.big_package)]
+        installed.append(big)
+
+    for repo in repos:
+        write_sync_db(os.path.join(dbpath, "sync", repo + ".db"),
+                      [p for p in sync if p.repo == repo])
+
+    write_file(os.path.join(dbpath, "local", "ALPM_DB_VERSION"), "9\n")
+    for pkg in installed:
+        pkgdir = os.path.join(dbpath, "local", "%s-%s" % (pkg.name, pkg.version))
+        os.makedirs(pkgdir, exist_ok=True)
+        write_file(os.path.join(pkgdir, "desc"),
+                   local_desc(pkg, rnd.random() < args.explicit,
+                              rnd.randint(1600000000, 1700000000)))
+        write_file(os.path.join(pkgdir, "files"), local_files(pkg))
+        if args.create_files:
+            for f in pkg.files:
+                path = os.path.join(root, f)
+                os.makedirs(os.path.dirname(path), exist_ok=True)
+                write_file(path, "x" * (1 if pkg.name == "big-package"
+                                        else rnd.randint(0, 4096)))
+
+    conf = "[options]\nRootDir = %s\nDBPath = %s/\nArchitecture = x86_64\n" \
+        % (os.path.abspath(root), os.path.abspath(dbpath))
+    for repo in repos:
+        conf += "\n[%s]\nServer = file:///dev/null\n" % repo
+    write_file(os.path.join(args.dir, "pacman.conf"), conf)
+
+    manifest = {
+        "installed": [p.name for p in rnd.sample(installed, min(100, len(installed)))],
+        "sync": [p.name for p in rnd.sample(sync, min(100, len(sync)))],
+        "provides": provides[:100],
+    }
+    with open(os.path.join(args.dir, "manifest.json"), "w") as f:
+        json.dump(manifest, f)
+
+
+if __name__ == "__main__":
+    main()
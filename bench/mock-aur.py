@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+#
+#  mock-aur.py - local stand-in for the AUR and archlinux.org endpoints
+#
+#  Serves /rpc.php (v5 search and info), /cgit/aur.git/plain/PKGBUILD
+#  and /packages/$repo/$arch/$name/json/ from a fixture corpus, either a
+#  file written by gen-aur-response.py --type info or packages generated
+#  at startup. Point package-query at it with:
+#    package-query --aur-url http://127.0.0.1:PORT \
+#                  --arch-url http://127.0.0.1:PORT/packages/ ...
+#
+#  Latency, bandwidth and error rate are configurable, and the server
+#  speaks HTTP/1.0 or HTTP/1.1 (keep-alive). The listening URL is
+#  printed on the first line of stdout, so that --port 0 can be used.
+#
+#  usage: mock-aur.py [--port P] [--fixtures FILE | --count N --seed S]
+#                     [--latency MS] [--jitter MS] [--bandwidth KBPS]
+#                     [--error-rate R] [--http 1.0|1.1] [--log]
+#
+import argparse
+import importlib.util
+import json
+import os
+import random
+import sys
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlsplit
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+# Keys of the info response missing from the search one
+INFO_KEYS = ("Depends", "MakeDepends", "OptDepends", "CheckDepends",
+             "Conflicts", "Provides", "Replaces", "Groups", "Keywords",
+             "License")
+
+
+def load_corpus(args):
+    if args.fixtures:
+        with open(args.fixtures) as f:
+            return json.load(f)["results"]
+    spec = importlib.util.spec_from_file_location(
+        "gen_aur_response", os.path.join(HERE, "gen-aur-response.py"))
+    gen = importlib.util.module_from_spec(spec)
+    spec.loader.exec_module(gen)
+    rnd = random.Random(args.seed)
+    return [gen.package(rnd, i, True) for i in range(args.count)]
+
+
+class Corpus:
+    def __init__(self, pkgs):
+        self.pkgs = pkgs
+        self.by_name = {p["Name"]: p for p in pkgs}
+        self.by_base = {p["PackageBase"]: p for p in pkgs}
+
+    def search(self, arg, by):
+        arg = arg.lower()
+        if by == "maintainer":
+            found = [p for p in self.pkgs if p.get("Maintainer") == arg]
+        elif by == "name":
+            found = [p for p in self.pkgs if arg in p["Name"].lower()]
+        else:
+            found = [p for p in self.pkgs if arg in p["Name"].lower()
+                     or arg in (p.get("Description") or "").lower()]
+        return [{k: v for k, v in p.items() if k not in INFO_KEYS} for p in found]
+
+    def info(self, names):
+        return [self.by_name[n] for n in names if n in self.by_name]
+
+
+def rpc_reply(kind, results=None, error=None):
+    reply = {"version": 5, "type": kind, "resultcount": len(results or []),
+             "results": results or []}
+    if error:
+        reply["error"] = error
+    return reply
+
+
+class Handler(BaseHTTPRequestHandler):
+    server_version = "mock-aur/1.0"
+
+    def log_message(self, fmt, *args):
+        if self.server.opts.log:
+            sys.stderr.write("%s %s\n" % (self.log_date_time_string(), fmt % args))
+
+    def send(self, code, body, ctype):
+        opts = self.server.opts
+        delay = opts.latency + random.uniform(0, opts.jitter)
+        if delay > 0:
+            time.sleep(delay / 1e3)
+        if random.random() < opts.error_rate:
+            if random.random() < 0.5:
+                # dropped connection
+                self.close_connection = True
+                return
+            code, body, ctype = 503, b"Service Unavailable\n", "text/plain"
+        self.send_response(code)
+        self.send_header("Content-Type", ctype)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        if not opts.bandwidth:
+            self.wfile.write(body)
+            return
+        # bandwidth in KB/s, written in 4 KB chunks
+        chunk = 4096
+        for i in range(0, len(body), chunk):
+            self.wfile.write(body[i:i + chunk])
+            self.wfile.flush()
+            time.sleep(len(body[i:i + chunk]) / (opts.bandwidth * 1024.0))
+
+    def send_json(self, obj):
+        self.send(200, json.dumps(obj).encode(), "application/json")
+
+    def do_GET(self):
+        corpus = self.server.corpus
+        url = urlsplit(self.path)
+        query = parse_qs(url.query)
+        path = url.path
+
+        if path == "/rpc.php":
+            kind = query.get("type", [""])[0]
+            if query.get("v", [""])[0] != "5":
+                self.send_json(rpc_reply("error", error="Invalid version specified."))
+            elif kind == "search":
+                arg = query.get("arg", [""])[0]
+                if len(arg) < 2:
+                    self.send_json(rpc_reply("error", error="Query arg too small."))
+                else:
+                    by = query.get("by", ["name-desc"])[0]
+                    self.send_json(rpc_reply("search", corpus.search(arg, by)))
+            elif kind == "info":
+                self.send_json(rpc_reply("multiinfo", corpus.info(query.get("arg[]", []))))
+            else:
+                self.send_json(rpc_reply("error", error="Incorrect request type specified."))
+        elif path == "/cgit/aur.git/plain/PKGBUILD":
+            pkg = corpus.by_base.get(query.get("h", [""])[0])
+            if not pkg:
+                self.send(404, b"Not found\n", "text/plain")
+                return
+            arch = "'any'" if pkg["ID"] % 3 == 0 else "'x86_64' 'i686'"
+            pkgbuild = "pkgname=%s\npkgver=%s\narch=(%s)\n" % (
+                pkg["Name"], pkg["Version"].rsplit("-", 1)[0], arch)
+            self.send(200, pkgbuild.encode(), "text/plain")
+        elif path.startswith("/packages/") and path.endswith("/json/"):
+            parts = path.split("/")
+            if len(parts) != 7:
+                self.send(404, b"Not found\n", "text/plain")
+                return
+            repo, arch, name = parts[2:5]
+            # flagged or not, the same way for a given name
+            flagged = random.Random(name).random() < 0.1
+            self.send_json({"pkgname": name, "repo": repo, "arch": arch,
+                            "flag_date": "2020-01-01T00:00:00Z" if flagged else None})
+        else:
+            self.send(404, b"Not found\n", "text/plain")
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=0)
+    parser.add_argument("--fixtures", help="output of gen-aur-response.py --type info")
+    parser.add_argument("--count", type=int, default=5000)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--latency", type=float, default=0, help="ms per response")
+    parser.add_argument("--jitter", type=float, default=0, help="random extra ms")
+    parser.add_argument("--bandwidth", type=float, default=0, help="KB/s, 0 for no limit")
+    parser.add_argument("--error-rate", type=float, default=0,
+                        help="share of requests answered 503 or dropped")
+    parser.add_argument("--http", choices=["1.0", "1.1"], default="1.1")
+    parser.add_argument("--log", action="store_true", help="log requests to stderr")
+    args = parser.parse_args()
+
+    Handler.protocol_version = "HTTP/" + args.http
+    server = ThreadingHTTPServer((args.host, args.port), Handler)
+    server.daemon_threads = True
+    server.opts = args
+    server.corpus = Corpus(load_corpus(args))
+    print("http://%s:%d" % server.server_address[:2], flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
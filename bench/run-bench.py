@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+#
+#  run-bench.py - time package-query operations on synthetic databases
+#
+#  For each size, a database is generated with gen-pacman-db.py, then
+#  every operation is run --runs times. One CSV line per size and
+#  operation is written to stdout, so that plotting the time against
+#  the number of installed packages shows how each operation scales.
+#
+#  With --aur, mock-aur.py is started on a generated corpus and the AUR
+#  operations are timed too, without leaving the machine.
+#
+#  usage: run-bench.py --binary src/package-query [--sizes 1000,10000]
+#                      [--runs 3] [--timeout 300] [--aur]
+#                      [gen-pacman-db options]
+#
+import argparse
+import csv
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+
+def aur_operations(names):
+    """(name, arguments) of the operations going to the AUR"""
+    return [
+        ("As", ["-As", "lib"]),
+        ("As --sort vote", ["-As", "lib", "--sort", "vote"]),
+        ("Ai", ["-Ai"] + names),
+        ("Ai -f", ["-Ai", "-f", "%n %v %D %M %w %p"] + names),
+    ]
+
+
+def start_mock(base, count):
+    """Start mock-aur.py, returns the process, its URL and some names"""
+    fixtures = os.path.join(base, "aur-info.json")
+    if not os.path.exists(fixtures):
+        with open(fixtures, "w") as f:
+            subprocess.run([sys.executable, os.path.join(HERE, "gen-aur-response.py"),
+                            "--type", "info", "--count", str(count)],
+                           stdout=f, check=True)
+    with open(fixtures) as f:
+        names = [p["Name"] for p in json.load(f)["results"][:100]]
+    proc = subprocess.Popen([sys.executable, os.path.join(HERE, "mock-aur.py"),
+                             "--fixtures", fixtures], stdout=subprocess.PIPE, text=True)
+    url = proc.stdout.readline().strip()
+    if not url:
+        proc.kill()
+        sys.exit("mock-aur.py did not start")
+    return proc, url, names
+
+
+def operations(manifest):
+    """(name, arguments) of the benchmarked operations"""
+    return [
+        ("Q", ["-Q"]),
+        ("Qdt", ["-Qdt"]),
+        ("Qm", ["-Qm"]),
+        ("Qu", ["-Qu"]),
+        ("Qs", ["-Qs", "lib"]),
+        ("Qi", ["-Qi"] + manifest["installed"]),
+        ("Ss", ["-Ss", "lib"]),
+        ("Ss --nameonly", ["-Ss", "--nameonly", "lib"]),
+        ("Sl", ["-Sl"]),
+        ("Si", ["-Si"] + manifest["sync"]),
+        ("Q --qprovides", ["-Q", "--qprovides"] + manifest["provides"]),
+        ("S --qprovides", ["-S", "--qprovides"] + manifest["provides"]),
+        ("Q -f", ["-Q", "-f", "%n %v %l %V %d %s %r %1 %2"]),
+        ("Ss -f", ["-Ss", "lib", "-f", "%n %v %l %d %r"]),
+        ("Ss --sort name", ["-Ss", "lib", "--sort", "name"]),
+        ("Ss --rsort name", ["-Ss", "lib", "--rsort", "name"]),
+        ("Qs --sort date", ["-Qs", "lib", "--sort", "date"]),
+        ("Qs --sort size", ["-Qs", "lib", "--sort", "size"]),
+        ("Ss --sort rel", ["-Ss", "lib", "--sort", "rel"]),
+    ]
+
+
+def run(cmd, timeout):
+    """Wall time (s), output lines and status of one run"""
+    start = time.perf_counter()
+    try:
+        proc = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.DEVNULL,
+                              timeout=timeout, env=dict(os.environ, LC_ALL="C"))
+    except subprocess.TimeoutExpired:
+        return None, 0, "timeout"
+    elapsed = time.perf_counter() - start
+    status = "ok" if proc.returncode in (0, 1) else "exit %d" % proc.returncode
+    return elapsed, proc.stdout.count(b"\n"), status
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--binary", required=True)
+    parser.add_argument("--sizes", default="1000,5000,20000,50000,200000",
+                        help="numbers of installed packages")
+    parser.add_argument("--runs", type=int, default=3)
+    parser.add_argument("--timeout", type=float, default=300)
+    parser.add_argument("--only", help="comma separated operation names")
+    parser.add_argument("--keep", help="keep the databases in this directory")
+    parser.add_argument("--aur", action="store_true",
+                        help="also time AUR operations against mock-aur.py")
+    parser.add_argument("--aur-count", type=int, default=5000,
+                        help="number of packages served by mock-aur.py")
+    args, gen_args = parser.parse_known_args()
+
+    out = csv.writer(sys.stdout)
+    out.writerow(["installed", "operation", "runs", "min_ms", "median_ms",
+                  "max_ms", "lines", "status"])
+    only = set(args.only.split(",")) if args.only else None
+    tmp = None if args.keep else tempfile.TemporaryDirectory(prefix="pq-bench-")
+    base = args.keep or tmp.name
+    os.makedirs(base, exist_ok=True)
+    mock = None
+    if args.aur:
+        mock, aur_url, aur_names = start_mock(base, args.aur_count)
+
+    for size in (int(s) for s in args.sizes.split(",")):
+        d = os.path.join(base, str(size))
+        if not os.path.exists(os.path.join(d, "pacman.conf")):
+            subprocess.run([sys.executable, os.path.join(HERE, "gen-pacman-db.py"),
+                            "--installed", str(size)] + gen_args + [d], check=True)
+        with open(os.path.join(d, "manifest.json")) as f:
+            manifest = json.load(f)
+        common = [args.binary, "--nocolor", "-c", os.path.join(d, "pacman.conf"),
+                  "-b", os.path.join(d, "db"), "-r", os.path.join(d, "root")]
+        ops = operations(manifest)
+        if mock:
+            common += ["--aur-url", aur_url, "--arch-url", aur_url + "/packages/"]
+            ops += aur_operations(aur_names)
+
+        for name, op in ops:
+            if only and name not in only:
+                continue
+            times, lines, status = [], 0, "ok"
+            for _ in range(args.runs):
+                elapsed, lines, status = run(common + op, args.timeout)
+                if elapsed is None:
+                    break
+                times.append(elapsed * 1e3)
+            if times:
+                out.writerow([size, name, len(times), "%.3f" % min(times),
+                              "%.3f" % statistics.median(times),
+                              "%.3f" % max(times), lines, status])
+            else:
+                out.writerow([size, name, 0, "", "", "", "", status])
+            sys.stdout.flush()
+
+    if mock:
+        mock.terminate()
+        mock.wait()
+    if tmp:
+        tmp.cleanup()
+
+
+if __name__ == "__main__":
+    main()
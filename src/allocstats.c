@@ -0,0 +1,282 @@
+/*
+ *  allocstats.c
+ *
+ *  Copyright (c) 2010-2012 Tuxce <tuxce.net@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "allocstats.h"
+
+/* Not util.h, whose macros are the ones being counted here */
+
+#define ALLOC_PHASE_DEPTH 16
+#define ALLOC_PTR_BUCKETS 4096
+
+typedef struct _alloccount_t
+{
+	unsigned long calls;
+	unsigned long reallocs;
+	/* a realloc () only counts the bytes it grows by */
+	unsigned long long bytes;
+	size_t live;
+	size_t peak;
+} alloccount_t;
+
+typedef struct _allocsite_t
+{
+	const char *file;
+	int line;
+	alloccount_t count;
+} allocsite_t;
+
+typedef struct _allocphase_t
+{
+	const char *name;
+	alloccount_t count;
+} allocphase_t;
+
+/* Live allocation */
+typedef struct _allocptr_t
+{
+	void *p;
+	size_t size;
+	size_t site;
+	size_t phase;
+	struct _allocptr_t *next;
+} allocptr_t;
+
+static pthread_mutex_t alloc_lock = PTHREAD_MUTEX_INITIALIZER;
+static alloccount_t total;
+static allocsite_t *sites = NULL;
+static size_t sites_count = 0;
+/* phases[0] is for allocations outside of any phase */
+static allocphase_t *phases = NULL;
+static size_t phases_count = 0;
+static allocptr_t *ptrs[ALLOC_PTR_BUCKETS];
+
+static __thread const char *phase_stack[ALLOC_PHASE_DEPTH];
+static __thread int phase_depth = 0;
+
+static void *alloc_raw (void *p, size_t size)
+{
+	if ((p = realloc (p, size)) == NULL) {
+		perror ("realloc");
+		exit (1);
+	}
+	return p;
+}
+
+void alloc_push_phase (const char *phase)
+{
+	if (phase_depth < ALLOC_PHASE_DEPTH) {
+		phase_stack[phase_depth] = phase;
+	}
+	phase_depth++;
+}
+
+void alloc_pop_phase (void)
+{
+	if (phase_depth) {
+		phase_depth--;
+	}
+}
+
+static size_t alloc_site (const char *file, int line)
+{
+	for (size_t i = 0; i < sites_count; i++) {
+		if (sites[i].line == line && strcmp (sites[i].file, file) == 0) {
+			return i;
+		}
+	}
+	sites = alloc_raw (sites, (sites_count + 1) * sizeof (allocsite_t));
+	memset (&(sites[sites_count]), 0, sizeof (allocsite_t));
+	sites[sites_count].file = file;
+	sites[sites_count].line = line;
+	return sites_count++;
+}
+
+static size_t alloc_phase (void)
+{
+	const char *name = NULL;
+	if (phase_depth) {
+		name = phase_stack[((phase_depth < ALLOC_PHASE_DEPTH) ? phase_depth : ALLOC_PHASE_DEPTH) - 1];
+	}
+	for (size_t i = 0; i < phases_count; i++) {
+		if (phases[i].name == name) {
+			return i;
+		}
+	}
+	phases = alloc_raw (phases, (phases_count + 1) * sizeof (allocphase_t));
+	memset (&(phases[phases_count]), 0, sizeof (allocphase_t));
+	phases[phases_count].name = name;
+	return phases_count++;
+}
+
+static inline size_t alloc_hash (const void *p)
+{
+	return ((uintptr_t) p >> 4) % ALLOC_PTR_BUCKETS;
+}
+
+static void count_add (alloccount_t *c, size_t size, size_t grown, bool resized)
+{
+	if (resized) {
+		c->reallocs++;
+	} else {
+		c->calls++;
+	}
+	c->bytes += grown;
+	c->live += size;
+	if (c->live > c->peak) {
+		c->peak = c->live;
+	}
+}
+
+static void count_sub (alloccount_t *c, size_t size)
+{
+	c->live = (c->live > size) ? c->live - size : 0;
+}
+
+/* Forget p and return its size, must be called with alloc_lock held */
+static size_t alloc_forget (void *p)
+{
+	allocptr_t **a = &(ptrs[alloc_hash (p)]);
+	while (*a && (*a)->p != p) {
+		a = &((*a)->next);
+	}
+	allocptr_t *ptr = *a;
+	if (!ptr) {
+		/* not allocated by us */
+		return 0;
+	}
+	*a = ptr->next;
+	const size_t size = ptr->size;
+	count_sub (&total, size);
+	count_sub (&(sites[ptr->site].count), size);
+	count_sub (&(phases[ptr->phase].count), size);
+	free (ptr);
+	return size;
+}
+
+/* grown is the size added by a realloc (), size for a new allocation,
+ * must be called with alloc_lock held */
+static void alloc_insert (void *p, size_t size, size_t grown, bool resized,
+		const char *file, int line)
+{
+	/* a stale entry from memory given to free () directly */
+	alloc_forget (p);
+	allocptr_t *ptr = alloc_raw (NULL, sizeof (allocptr_t));
+	ptr->p = p;
+	ptr->size = size;
+	ptr->site = alloc_site (file, line);
+	ptr->phase = alloc_phase ();
+	ptr->next = ptrs[alloc_hash (p)];
+	ptrs[alloc_hash (p)] = ptr;
+	count_add (&total, size, grown, resized);
+	count_add (&(sites[ptr->site].count), size, grown, resized);
+	count_add (&(phases[ptr->phase].count), size, grown, resized);
+}
+
+static void *alloc_track (void *p, size_t size, size_t grown, bool resized,
+		const char *file, int line)
+{
+	if (!p) {
+		return NULL;
+	}
+	pthread_mutex_lock (&alloc_lock);
+	alloc_insert (p, size, grown, resized, file, line);
+	pthread_mutex_unlock (&alloc_lock);
+	return p;
+}
+
+void *alloc_calloc (size_t n, size_t size, const char *file, int line)
+{
+	return alloc_track (calloc (n, size), n * size, n * size, false, file, line);
+}
+
+void *alloc_realloc (void *p, size_t size, const char *file, int line)
+{
+	/* held across realloc () so that another thread cannot be given p
+	 * and track it before its old entry is forgotten */
+	pthread_mutex_lock (&alloc_lock);
+	void *r = realloc (p, size);
+	if (r) {
+		const size_t old = p ? alloc_forget (p) : 0;
+		alloc_insert (r, size, (size > old) ? size - old : 0, p != NULL, file, line);
+	}
+	pthread_mutex_unlock (&alloc_lock);
+	return r;
+}
+
+char *alloc_strdup (const char *s, const char *file, int line)
+{
+	const size_t size = strlen (s) + 1;
+	return alloc_track (strdup (s), size, size, false, file, line);
+}
+
+void alloc_free (void *p)
+{
+	if (!p) {
+		return;
+	}
+	pthread_mutex_lock (&alloc_lock);
+	alloc_forget (p);
+	pthread_mutex_unlock (&alloc_lock);
+	free (p);
+}
+
+static void alloc_print (const char *name, const alloccount_t *c)
+{
+	fprintf (stderr, "%-32s %10lu %10lu %14llu %12zu %12zu\n", name, c->calls,
+			c->reallocs, c->bytes, c->peak, c->live);
+}
+
+static int site_cmp (const void *s1, const void *s2)
+{
+	const allocsite_t *a = s1, *b = s2;
+	return (b->count.bytes > a->count.bytes) - (b->count.bytes < a->count.bytes);
+}
+
+void alloc_report (void)
+{
+	/* a realloc() of NULL counts as an allocation */
+	fprintf (stderr, "%-32s %10s %10s %14s %12s %12s\n", "phase", "allocs", "reallocs",
+			"bytes", "peak live", "live");
+	for (size_t i = 0; i < phases_count; i++) {
+		alloc_print ((phases[i].name) ? phases[i].name : "(none)", &(phases[i].count));
+	}
+	alloc_print ("total", &total);
+
+	fprintf (stderr, "\n%-32s %10s %10s %14s %12s %12s\n", "call site", "allocs", "reallocs",
+			"bytes", "peak live", "live");
+	/* sorted copy, live allocations keep their site index */
+	allocsite_t *sorted = alloc_raw (NULL, (sites_count + 1) * sizeof (allocsite_t));
+	memcpy (sorted, sites, sites_count * sizeof (allocsite_t));
+	qsort (sorted, sites_count, sizeof (allocsite_t), site_cmp);
+	for (size_t i = 0; i < sites_count; i++) {
+		char name[64];
+		snprintf (name, sizeof (name), "%s:%d", sorted[i].file, sorted[i].line);
+		alloc_print (name, &(sorted[i].count));
+	}
+	free (sorted);
+}
+
+/* vim: set ts=4 sw=4 noet: */
@@ -0,0 +1,44 @@
+/*
+ *  allocstats.h
+ *
+ *  Copyright (c) 2010-2012 Tuxce <tuxce.net@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PQ_ALLOCSTATS_H
+#define PQ_ALLOCSTATS_H
+
+#include <stddef.h>
+
+/*
+ * Built with --enable-alloc-stats, MALLOC/CALLOC/REALLOC/STRDUP/FREE
+ * (util.h) go through these functions, which count allocations and
+ * bytes per call site and per --stats phase. Memory released with a
+ * plain free() is still seen as live until its address is reused.
+ */
+void *alloc_calloc (size_t n, size_t size, const char *file, int line);
+void *alloc_realloc (void *p, size_t size, const char *file, int line);
+char *alloc_strdup (const char *s, const char *file, int line);
+void alloc_free (void *p);
+
+/* Allocations are attributed to the innermost phase of the thread */
+void alloc_push_phase (const char *phase);
+void alloc_pop_phase (void);
+
+/* alloc_report() prints the totals to stderr */
+void alloc_report (void);
+
+#endif
+
+/* vim: set ts=4 sw=4 noet: */
@@ -16,6 +16,7 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include "config.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -27,8 +28,9 @@
 
 #include "util.h"
 #include "alpm-query.h"
+#include "stats.h"
+#include "probes.h"
 
-#define ARCH_PACKAGES_URL "https://www.archlinux.org/packages/"
 #define OUTOFDATE_FLAG "\"flag_date\": "
 
 typedef const char *(*retcharfn) (void *);
@@ -63,7 +65,9 @@ static bool init_alpm (void)
 		}
 	}
 	enum _alpm_errno_t err;
+	stats_begin (ST_ALPM, NULL);
 	alpm_handle_t *handle = alpm_initialize (config.rootdir, config.dbpath, &err);
+	stats_end ();
 	if (!handle) {
 		fprintf (stderr, "failed to initialize alpm library (%s)\n", alpm_strerror (err));
 		return false;
@@ -79,7 +83,11 @@ static bool init_alpm (void)
 static bool parse_config_options (char *ptr, alpm_db_t **db, alpm_list_t **dbs, bool reg)
 {
 	if (reg) {
-		if ((*db = alpm_register_syncdb (config.handle, ptr, ALPM_SIG_USE_DEFAULT)) == NULL) {
+		stats_begin (ST_ALPM, NULL);
+		stats_note (ptr);
+		*db = alpm_register_syncdb (config.handle, ptr, ALPM_SIG_USE_DEFAULT);
+		stats_end ();
+		if (*db == NULL) {
 			fprintf (stderr, "could not register '%s' database (%s)\n", ptr,
 					alpm_strerror(alpm_errno(config.handle)));
 			return false;
@@ -98,10 +106,10 @@ static void parse_config_server (char *ptr, alpm_db_t *db)
 	if (arch) {
 		char *temp = server;
 		server = strreplace (temp, "$arch", arch);
-		free (temp);
+		FREE (temp);
 	}
 	alpm_db_add_server (db, server);
-	free (server);
+	FREE (server);
 }
 
 static bool parse_configfile (alpm_list_t **dbs, const char *configfile, bool reg)
@@ -200,13 +208,18 @@ static bool parse_configfile (alpm_list_t **dbs, const char *configfile, bool re
 alpm_list_t *get_db_sync (void)
 {
 	alpm_list_t *dbs = NULL;
+	stats_begin (ST_CONFIG, NULL);
 	parse_configfile (&dbs, config.configfile, false);
+	stats_end ();
 	return dbs;
 }
 
 bool init_db_sync (void)
 {
-	return parse_configfile (NULL, config.configfile, true);
+	stats_begin (ST_CONFIG, NULL);
+	const bool ret = parse_configfile (NULL, config.configfile, true);
+	stats_end ();
+	return ret;
 }
 
 static alpm_pkg_t *get_sync_pkg_by_name (const char *pkgname)
@@ -229,7 +242,7 @@ static alpm_pkg_t *get_sync_pkg (alpm_pkg_t *pkg)
 	return pkg;
 }
 
-static bool filter (alpm_pkg_t *pkg, unsigned int _filter)
+static bool filter_match (alpm_pkg_t *pkg, unsigned int _filter)
 {
 	if ((_filter & F_FOREIGN) && get_sync_pkg (pkg))
 		return false;
@@ -260,6 +273,14 @@ static bool filter (alpm_pkg_t *pkg, unsigned int _filter)
 	return true;
 }
 
+static bool filter (alpm_pkg_t *pkg, unsigned int _filter)
+{
+	const uint64_t probe_start = PROBE_START (filter);
+	const bool ret = filter_match (pkg, _filter);
+	PROBE_DONE3 (filter, probe_start, alpm_pkg_get_name (pkg), _filter, (int) ret);
+	return ret;
+}
+
 static int filter_state (alpm_pkg_t *pkg)
 {
 	int ret = 0;
@@ -305,6 +326,7 @@ unsigned int search_pkg_by_type (alpm_db_t *db, alpm_list_t **targets)
 
 	for (const alpm_list_t *i = alpm_db_get_pkgcache (db); i && *targets; i = alpm_list_next (i)) {
 		alpm_pkg_t *pkg = i->data;
+		stats_count (SC_SCANNED, 1);
 		alpm_list_t *pkg_info_list = f (pkg);
 		for (const alpm_list_t *j = pkg_info_list; j && *targets; j = alpm_list_next (j)) {
 			char *str = (char *) ((g) ? g(j->data) : j->data);
@@ -355,6 +377,7 @@ unsigned int search_pkg_by_name (alpm_db_t *db, alpm_list_t **targets)
 			continue;
 		}
 		alpm_pkg_t *pkg_found = alpm_db_get_pkg (db, t1->name);
+		stats_count (SC_SCANNED, 1);
 		if (pkg_found && filter (pkg_found, config.filter) &&
 				target_check_version (t1, alpm_pkg_get_version (pkg_found))) {
 			ret++;
@@ -394,6 +417,8 @@ unsigned int list_grp (alpm_db_t *db, alpm_list_t *targets)
 unsigned int search_pkg (alpm_db_t *db, alpm_list_t *targets)
 {
 	unsigned int ret = 0;
+	/* alpm_db_search() goes through the whole db */
+	stats_count (SC_SCANNED, alpm_list_count (alpm_db_get_pkgcache (db)));
 	alpm_list_t *pkgs = alpm_db_search (db, targets);
 	for (const alpm_list_t *t = pkgs; t; t = alpm_list_next (t)) {
 		alpm_pkg_t *info = t->data;
@@ -414,6 +439,7 @@ unsigned int alpm_search_local (unsigned short _filter, const char *format, alpm
 	for (const alpm_list_t *i = alpm_db_get_pkgcache (alpm_get_localdb(config.handle));
 			i; i = alpm_list_next (i)) {
 		alpm_pkg_t *pkg = i->data;
+		stats_count (SC_SCANNED, 1);
 		if (filter (pkg, _filter)) {
 			if (res) {
 				*res = alpm_list_add (*res,
@@ -435,6 +461,7 @@ unsigned int list_db (alpm_db_t *db, alpm_list_t *targets)
 	}
 	unsigned int ret = 0;
 	for (const alpm_list_t *i = alpm_db_get_pkgcache (db); i; i = alpm_list_next (i)) {
+		stats_count (SC_SCANNED, 1);
 		print_or_add_result (i->data, R_ALPM_PKG);
 		ret++;
 	}
@@ -456,10 +483,24 @@ off_t get_size_pkg (alpm_pkg_t *pkg)
 	return 0;
 }
 
+typedef struct _inodesize_t
+{
+	ino_t ino;
+	off_t size;
+} inodesize_t;
+
+static int inodesize_cmp (const void *i1, const void *i2)
+{
+	const ino_t ino1 = ((const inodesize_t *) i1)->ino;
+	const ino_t ino2 = ((const inodesize_t *) i2)->ino;
+	return (ino1 > ino2) - (ino1 < ino2);
+}
+
+/* Hard links are counted once: inodes are sorted, then summed once each */
 static off_t alpm_pkg_get_realsize (alpm_pkg_t *pkg)
 {
 	const alpm_filelist_t *files = alpm_pkg_get_files (pkg);
-	if (!files) {
+	if (!files || !files->count) {
 		return 0;
 	}
 
@@ -468,28 +509,28 @@ static off_t alpm_pkg_get_realsize (alpm_pkg_t *pkg)
 		return 0;
 	}
 
-	off_t size = 0;
-	ino_t inodes[files->count];
-	memset (&inodes, 0, sizeof (inodes));
-	for (size_t k = 0, j = 0; k < files->count; k++) {
+	inodesize_t *inodes;
+	MALLOC (inodes, files->count * sizeof (inodesize_t));
+	size_t n = 0;
+	for (size_t k = 0; k < files->count; k++) {
 		const alpm_file_t *f = files->files + k;
 		struct stat buf;
 		if (lstat (f->name, &buf) == -1 || !(S_ISREG (buf.st_mode) || S_ISLNK (buf.st_mode))) {
 			continue;
 		}
-		bool found = false;
-		for (size_t i = 0; i < files->count && i < j && !found; i++) {
-			if (inodes[i] == buf.st_ino) {
-				found = true;
-				break;
-			}
-		}
-		if (found) {
-			continue;
+		inodes[n].ino = buf.st_ino;
+		inodes[n].size = buf.st_size;
+		n++;
+	}
+	qsort (inodes, n, sizeof (inodesize_t), inodesize_cmp);
+
+	off_t size = 0;
+	for (size_t k = 0; k < n; k++) {
+		if (k == 0 || inodes[k].ino != inodes[k - 1].ino) {
+			size += inodes[k].size;
 		}
-		inodes[j++] = buf.st_ino;
-		size += buf.st_size;
 	}
+	FREE (inodes);
 	return size;
 }
 
@@ -511,7 +552,7 @@ static bool alpm_pkg_get_outofdate (alpm_pkg_t *pkg)
 	}
 
 	/* https://www.archlinux.org/packages/$repo/$arch/$name/json/ */
-	int ret = asprintf (&url, "%s%s/%s/%s/json/", ARCH_PACKAGES_URL, repo, arch, name);
+	int ret = asprintf (&url, "%s%s/%s/%s/json/", config.arch_url, repo, arch, name);
 	if (ret > 0) {
 		char *res = curl_fetch (curl, url);
 		if (res) {
@@ -519,7 +560,7 @@ static bool alpm_pkg_get_outofdate (alpm_pkg_t *pkg)
 			if (f && strncmp (f + strlen (OUTOFDATE_FLAG), "null", strlen ("null")) != 0) {
 				flagged = true;
 			}
-			free (res);
+			FREE (res);
 		}
 	}
 
@@ -531,27 +572,18 @@ static bool alpm_pkg_get_outofdate (alpm_pkg_t *pkg)
 const char *alpm_pkg_get_str (const void *p, unsigned char c)
 {
 	alpm_pkg_t *pkg = (alpm_pkg_t *) p;
-	static char *info = NULL;
-	static bool free_info = false;
-	if (free_info) {
-		free (info);
-		free_info = false;
-	}
-	info = NULL;
+	char *info = NULL;
 	switch (c) {
 		case '2':
 			info = ltostr (alpm_pkg_get_isize (pkg));
-			free_info = true;
 			break;
 		case '5':
 			pkg = get_sync_pkg (pkg);
 			if (!pkg) break;
 			info = ltostr (alpm_pkg_download_size (pkg));
-			free_info = true;
 			break;
 		case '6':
 			info = ttostr (alpm_pkg_get_builddate (pkg));
-			free_info = true;
 			break;
 		case 'a':
 			info = (char *) alpm_pkg_get_arch (pkg);
@@ -561,38 +593,31 @@ const char *alpm_pkg_get_str (const void *p, unsigned char c)
 			break;
 		case 'B':
 			info = concat_backup_list (alpm_pkg_get_backup (pkg));
-			free_info = true;
 			break;
 		case 'c':
 			if (alpm_pkg_get_origin (pkg) != ALPM_PKG_FROM_FILE) break;
 			info = concat_dep_list (alpm_pkg_get_checkdepends (pkg));
-			free_info = true;
 			break;
 		case 'C':
 			info = concat_dep_list (alpm_pkg_get_conflicts (pkg));
-			free_info = true;
 			break;
 		case 'd':
 			info = (char *) alpm_pkg_get_desc (pkg);
 			break;
 		case 'D':
 			info = concat_dep_list (alpm_pkg_get_depends (pkg));
-			free_info = true;
 			break;
 		case 'e':
 			info = concat_str_list (alpm_pkg_get_licenses (pkg));
-			free_info = true;
 			break;
 		case 'f':
 			info = (char *) alpm_pkg_get_filename (pkg);
 			break;
 		case 'g':
 			info = concat_str_list (alpm_pkg_get_groups (pkg));
-			free_info = true;
 			break;
 		case 'I':
 			info = itostr (alpm_pkg_has_scriptlet (pkg));
-			free_info = true;
 			break;
 		case 'm':
 			info = (char *) alpm_pkg_get_packager (pkg);
@@ -600,7 +625,6 @@ const char *alpm_pkg_get_str (const void *p, unsigned char c)
 		case 'M':
 			if (alpm_pkg_get_origin (pkg) != ALPM_PKG_FROM_FILE) break;
 			info = concat_dep_list (alpm_pkg_get_makedepends (pkg));
-			free_info = true;
 			break;
 		case 'n':
 			info = (char *) alpm_pkg_get_name (pkg);
@@ -610,26 +634,21 @@ const char *alpm_pkg_get_str (const void *p, unsigned char c)
 				alpm_list_t *reqs = alpm_pkg_compute_requiredby (pkg);
 				info = concat_str_list (reqs);
 				FREELIST (reqs);
-				free_info = true;
 			}
 			break;
 		case 'o':
 			pkg = get_sync_pkg (pkg);
 			if (!pkg) break;
 			info = itostr (alpm_pkg_get_outofdate (pkg));
-			free_info = true;
 			break;
 		case 'O':
 			info = concat_dep_list (alpm_pkg_get_optdepends (pkg));
-			free_info = true;
 			break;
 		case 'P':
 			info = concat_dep_list (alpm_pkg_get_provides (pkg));
-			free_info = true;
 			break;
 		case 'R':
 			info = concat_dep_list (alpm_pkg_get_replaces (pkg));
-			free_info = true;
 			break;
 		case 's':
 			pkg = get_sync_pkg (pkg);
@@ -645,9 +664,7 @@ const char *alpm_pkg_get_str (const void *p, unsigned char c)
 					const char *dburl = servers->data;
 					const char *pkgfilename = alpm_pkg_get_filename (pkg);
 					if (!dburl || !pkgfilename) return NULL;
-					CALLOC (info, strlen (dburl) + strlen (pkgfilename) + 2, sizeof (char));
-					sprintf (info, "%s/%s", dburl, pkgfilename);
-					free_info = true;
+					info = record_strjoin (dburl, "/", pkgfilename, NULL);
 				}
 			}
 			break;
@@ -667,15 +684,43 @@ const char *alpm_pkg_get_str (const void *p, unsigned char c)
 	return info;
 }
 
+void alpm_pkg_json (yajl_gen g, alpm_pkg_t *pkg)
+{
+	alpm_pkg_t *sync_pkg = get_sync_pkg (pkg);
+
+	json_gen_str (g, "name", alpm_pkg_get_name (pkg));
+	json_gen_str (g, "version", alpm_pkg_get_version (pkg));
+	json_gen_str (g, "base", alpm_pkg_get_base (pkg));
+	json_gen_str (g, "description", alpm_pkg_get_desc (pkg));
+	json_gen_str (g, "arch", alpm_pkg_get_arch (pkg));
+	json_gen_str (g, "url", alpm_pkg_get_url (pkg));
+	json_gen_str (g, "filename", alpm_pkg_get_filename (pkg));
+	json_gen_str (g, "packager", alpm_pkg_get_packager (pkg));
+	json_gen_str (g, "repository", alpm_db_get_name (alpm_pkg_get_db (pkg)));
+	json_gen_str (g, "sync_repository", alpm_db_get_name (alpm_pkg_get_db (sync_pkg ? sync_pkg : pkg)));
+	json_gen_str (g, "sync_version", sync_pkg ? alpm_pkg_get_version (sync_pkg) : NULL);
+	json_gen_int (g, "builddate", alpm_pkg_get_builddate (pkg));
+	json_gen_int (g, "installdate", alpm_pkg_get_installdate (pkg));
+	json_gen_int (g, "isize", alpm_pkg_get_isize (pkg));
+	json_gen_int (g, "download_size", sync_pkg ? alpm_pkg_download_size (sync_pkg) : 0);
+	json_gen_bool (g, "install_script", alpm_pkg_has_scriptlet (pkg));
+	json_gen_str_list (g, "licenses", alpm_pkg_get_licenses (pkg));
+	json_gen_str_list (g, "groups", alpm_pkg_get_groups (pkg));
+	json_gen_dep_list (g, "depends", alpm_pkg_get_depends (pkg));
+	json_gen_dep_list (g, "optdepends", alpm_pkg_get_optdepends (pkg));
+	if (alpm_pkg_get_origin (pkg) == ALPM_PKG_FROM_FILE) {
+		json_gen_dep_list (g, "checkdepends", alpm_pkg_get_checkdepends (pkg));
+		json_gen_dep_list (g, "makedepends", alpm_pkg_get_makedepends (pkg));
+	}
+	json_gen_dep_list (g, "conflicts", alpm_pkg_get_conflicts (pkg));
+	json_gen_dep_list (g, "provides", alpm_pkg_get_provides (pkg));
+	json_gen_dep_list (g, "replaces", alpm_pkg_get_replaces (pkg));
+	json_gen_backup_list (g, "backup", alpm_pkg_get_backup (pkg));
+	json_gen_file_list (g, "files", alpm_pkg_get_files (pkg));
+}
+
 const char *alpm_local_pkg_get_str (const char *pkg_name, unsigned char c)
 {
-	static char *info = NULL;
-	static bool free_info = false;
-	if (free_info) {
-		free (info);
-		free_info = false;
-	}
-	info = NULL;
 	if (!pkg_name) {
 		return NULL;
 	}
@@ -685,25 +730,22 @@ const char *alpm_local_pkg_get_str (const char *pkg_name, unsigned char c)
 		return NULL;
 	}
 
+	char *info = NULL;
 	switch (c) {
 		case 'l':
 			info = (char *) alpm_pkg_get_version (pkg);
 			break;
 		case 'F':
 			info = concat_file_list (alpm_pkg_get_files (pkg));
-			free_info = true;
 			break;
 		case '1':
 			info = ttostr (alpm_pkg_get_installdate (pkg));
-			free_info = true;
 			break;
 		case '3':
 			info = ltostr (alpm_pkg_get_realsize (pkg));
-			free_info = true;
 			break;
 		case '4':
 			info = itostr (filter_state (pkg));
-			free_info = true;
 			break;
 		default:
 			return NULL;
@@ -726,10 +768,4 @@ const char *alpm_grp_get_str (const void *p, unsigned char c)
 	}
 }
 
-void alpm_cleanup (void)
-{
-	alpm_pkg_get_str (NULL, 0);
-	alpm_local_pkg_get_str (NULL, 0);
-}
-
 /* vim: set ts=4 sw=4 noet: */
@@ -21,7 +21,10 @@
 #include <stdbool.h>
 #include <alpm.h>
 #include <alpm_list.h>
+#include <yajl/yajl_gen.h>
 
+/* default for --arch-url */
+#define ARCH_PACKAGES_URL "https://www.archlinux.org/packages/"
 
 /*
  * Filter
@@ -63,13 +66,18 @@ off_t get_size_pkg (alpm_pkg_t *pkg);
  * alpm_pkg_get_str() get info for package
  * alpm_local_pkg_get_str() get info for local package
  * alpm_grp_get_str() get info for group
- * str returned should not be passed to free
+ * str returned lives in the record arena and should not be passed to free
  */
 const char *alpm_pkg_get_str (const void *p, unsigned char c);
 const char *alpm_local_pkg_get_str (const char *pkg_name, unsigned char c);
 const char *alpm_grp_get_str (const void *p, unsigned char c);
 
-void alpm_cleanup (void);
+/*
+ * alpm_pkg_json() adds package fields to the current JSON object
+ * Fields needing network access or a full db scan (%o, %3, %4, %N)
+ * are left out.
+ */
+void alpm_pkg_json (yajl_gen g, alpm_pkg_t *pkg);
 
 #endif
 
@@ -16,6 +16,7 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include "config.h"
 #include <string.h>
 #include <errno.h>
 #include <locale.h>
@@ -26,6 +27,9 @@
 #include "aur.h"
 #include "alpm-query.h"
 #include "util.h"
+#include "jsonscan.h"
+#include "stats.h"
+#include "probes.h"
 
 /*
  * AUR url
@@ -45,71 +49,63 @@
 #define AUR_REPO "aur"
 
 /*
- * AUR package information
+ * AUR package information, the enum and the key names are both
+ * generated from this list
  */
+#define AUR_KEYS(X) \
+	X (AUR_CHECKDEPENDS,     "CheckDepends") \
+	X (AUR_CONFLICTS,        "Conflicts") \
+	X (AUR_DEPENDS,          "Depends") \
+	X (AUR_DESCRIPTION,      "Description") \
+	X (AUR_FIRST,            "FirstSubmitted") \
+	X (AUR_GROUPS,           "Groups") \
+	X (AUR_ID,               "ID") \
+	X (AUR_KEYWORDS,         "Keywords") \
+	X (AUR_LAST,             "LastModified") \
+	X (AUR_LICENSES,         "License") \
+	X (AUR_MAINTAINER,       "Maintainer") \
+	X (AUR_MAKEDEPENDS,      "MakeDepends") \
+	X (AUR_NAME,             "Name") \
+	X (AUR_NUMVOTES,         "NumVotes") \
+	X (AUR_OPTDEPENDS,       "OptDepends") \
+	X (AUR_OUTOFDATE,        "OutOfDate") \
+	X (AUR_PKGBASE,          "PackageBase") \
+	X (AUR_PKGBASE_ID,       "PackageBaseID") \
+	X (AUR_POPULARITY,       "Popularity") \
+	X (AUR_PROVIDES,         "Provides") \
+	X (AUR_REPLACES,         "Replaces") \
+	X (AUR_URL,              "URL") \
+	X (AUR_URLPATH,          "URLPath") \
+	X (AUR_VERSION,          "Version") \
+	X (AUR_JSON_RESULTS_KEY, "results") \
+	X (AUR_JSON_TYPE_KEY,    "type")
+
+#define AUR_KEY_ID(id, name) id,
+#define AUR_KEY_NAME(id, name) name,
+
 typedef enum
 {
-	AUR_CHECKDEPENDS = 1,
-	AUR_CONFLICTS,
-	AUR_DEPENDS,
-	AUR_DESCRIPTION,
-	AUR_FIRST,
-	AUR_GROUPS,
-	AUR_ID,
-	AUR_KEYWORDS,
-	AUR_LAST,
-	AUR_LICENSES,
-	AUR_MAINTAINER,
-	AUR_MAKEDEPENDS,
-	AUR_NAME,
-	AUR_NUMVOTES,
-	AUR_OPTDEPENDS,
-	AUR_OUTOFDATE,
-	AUR_PKGBASE,
-	AUR_PKGBASE_ID,
-	AUR_POPULARITY,
-	AUR_PROVIDES,
-	AUR_REPLACES,
-	AUR_URL,
-	AUR_URLPATH,
-	AUR_VERSION,
-	AUR_JSON_RESULTS_KEY,
-	AUR_JSON_TYPE_KEY
+	AUR_NO_KEY = 0,
+	AUR_KEYS (AUR_KEY_ID)
+	AUR_KEY_COUNT
 } aurkeytype_t;
 
-#define AUR_LAST_ID AUR_JSON_TYPE_KEY
-
 static const char *aur_key_types_names[] =
 {
 	"",
-	"CheckDepends",
-	"Conflicts",
-	"Depends",
-	"Description",
-	"FirstSubmitted",
-	"Groups",
-	"ID",
-	"Keywords",
-	"LastModified",
-	"License",
-	"Maintainer",
-	"MakeDepends",
-	"Name",
-	"NumVotes",
-	"OptDepends",
-	"OutOfDate",
-	"PackageBase",
-	"PackageBaseID",
-	"Popularity",
-	"Provides",
-	"Replaces",
-	"URL",
-	"URLPath",
-	"Version",
-	"results",
-	"type"
+	AUR_KEYS (AUR_KEY_NAME)
 };
 
+/*
+ * Key lookup table, filled on first use. The hash only looks at the
+ * length and the first and last characters, it is collision free for
+ * the keys above, linear probing keeps it right if that changes.
+ */
+#define AUR_KEY_HASH_SIZE 64
+#define AUR_KEY_HASH(s, len) \
+	(((unsigned char) (s)[0] * 6 + (unsigned char) (s)[(len) - 1] * 29 + (len)) \
+	 & (AUR_KEY_HASH_SIZE - 1))
+
 /* AUR JSON error */
 #define AUR_TYPE_ERROR   "error"
 
@@ -123,10 +119,16 @@ static const char *aur_key_types_names[] =
 /*
  * JSON parse packages
  */
-#define AUR_ID_LEN 20
 typedef struct _jsonpkg_t
 {
-	alpm_list_t *pkgs;
+	arena_t *arena;
+	aurpkg_t **pkgs;
+	size_t pkgs_count;
+	size_t pkgs_size;
+	/* values of the array being parsed */
+	const char **strs;
+	size_t strs_count;
+	size_t strs_size;
 	aurpkg_t *pkg;
 	aurkeytype_t current_key;
 	bool error;
@@ -134,76 +136,39 @@ typedef struct _jsonpkg_t
 	int level;
 } jsonpkg_t;
 
-
-
-static aurpkg_t *aur_pkg_new (void)
+/*
+ * Packages of one RPC response, everything (strings, arrays, this
+ * struct) lives in arena and goes away with aur_response_free().
+ */
+struct _aurresponse_t
 {
-	aurpkg_t *pkg = NULL;
-	MALLOC (pkg, sizeof (aurpkg_t));
-	return pkg;
-}
+	arena_t *arena;
+	aurpkg_t **pkgs;
+	size_t count;
+};
+
+/* Initial size of the response arena */
+#define AUR_ARENA_SIZE 16384
 
-void aur_pkg_free (aurpkg_t *pkg)
+void aur_response_free (aurresponse_t *res)
 {
-	if (!pkg) {
-		return;
+	if (res) {
+		arena_free (res->arena);
 	}
-
-	FREE (pkg->desc);
-	FREE (pkg->maintainer);
-	FREE (pkg->name);
-	FREE (pkg->pkgbase);
-	FREE (pkg->url);
-	FREE (pkg->urlpath);
-	FREE (pkg->version);
-
-	FREELIST (pkg->checkdepends);
-	FREELIST (pkg->conflicts);
-	FREELIST (pkg->depends);
-	FREELIST (pkg->groups);
-	FREELIST (pkg->keywords);
-	FREELIST (pkg->licenses);
-	FREELIST (pkg->makedepends);
-	FREELIST (pkg->optdepends);
-	FREELIST (pkg->provides);
-	FREELIST (pkg->replaces);
-
-	FREE (pkg);
 }
 
-aurpkg_t *aur_pkg_dup (const aurpkg_t *pkg)
+static aurpkg_t *aur_pkg_new (arena_t *arena)
 {
-	if (!pkg) {
-		return NULL;
-	}
-
-	aurpkg_t *pkg_ret = aur_pkg_new ();
-
-	// Only copy the values provided by the AUR search request
-	// (all array values are not provided)
-	pkg_ret->firstsubmit = pkg->firstsubmit;
-	pkg_ret->id = pkg->id;
-	pkg_ret->lastmod = pkg->lastmod;
-	pkg_ret->outofdate = pkg->outofdate;
-	pkg_ret->pkgbase_id = pkg->pkgbase_id;
-	pkg_ret->popularity = pkg->popularity;
-	pkg_ret->votes = pkg->votes;
-
-	pkg_ret->desc = STRDUP (pkg->desc);
-	pkg_ret->maintainer = STRDUP (pkg->maintainer);
-	pkg_ret->name = STRDUP (pkg->name);
-	pkg_ret->pkgbase = STRDUP (pkg->pkgbase);
-	pkg_ret->url = STRDUP (pkg->url);
-	pkg_ret->urlpath = STRDUP (pkg->urlpath);
-	pkg_ret->version = STRDUP (pkg->version);
-
-	return pkg_ret;
+	aurpkg_t *pkg = arena_alloc (arena, sizeof (aurpkg_t));
+	memset (pkg, 0, sizeof (aurpkg_t));
+	return pkg;
 }
 
+/* Sort functions on arrays of aurpkg_t pointers */
 static int aur_pkg_cmp (const void *p1, const void *p2)
 {
-	const aurpkg_t *pkg1 = (const aurpkg_t *) p1;
-	const aurpkg_t *pkg2 = (const aurpkg_t *) p2;
+	const aurpkg_t *pkg1 = *(aurpkg_t *const *) p1;
+	const aurpkg_t *pkg2 = *(aurpkg_t *const *) p2;
 	if (pkg1 && pkg1->name && pkg2 && pkg2->name) {
 		return strcmp (pkg1->name, pkg2->name);
 	}
@@ -212,8 +177,8 @@ static int aur_pkg_cmp (const void *p1, const void *p2)
 
 static int aur_pkg_votes_cmp (const void *p1, const void *p2)
 {
-	const aurpkg_t *pkg1 = (const aurpkg_t *) p1;
-	const aurpkg_t *pkg2 = (const aurpkg_t *) p2;
+	const aurpkg_t *pkg1 = *(aurpkg_t *const *) p1;
+	const aurpkg_t *pkg2 = *(aurpkg_t *const *) p2;
 	if (pkg1 && pkg2 && (pkg1->votes > pkg2->votes)) {
 		return 1;
 	}
@@ -223,7 +188,7 @@ static int aur_pkg_votes_cmp (const void *p1, const void *p2)
 	return 0;
 }
 
-static char *aur_pkg_get_string_value (const aurpkg_t *pkg, aurkeytype_t key)
+static char **aur_pkg_str_field (aurpkg_t *pkg, aurkeytype_t key)
 {
 	if (!pkg) {
 		return NULL;
@@ -231,25 +196,31 @@ static char *aur_pkg_get_string_value (const aurpkg_t *pkg, aurkeytype_t key)
 
 	switch (key) {
 		case AUR_DESCRIPTION:
-			return pkg->desc;
+			return &(pkg->desc);
 		case AUR_MAINTAINER:
-			return pkg->maintainer;
+			return &(pkg->maintainer);
 		case AUR_NAME:
-			return pkg->name;
+			return &(pkg->name);
 		case AUR_PKGBASE:
-			return pkg->pkgbase;
+			return &(pkg->pkgbase);
 		case AUR_URL:
-			return pkg->url;
+			return &(pkg->url);
 		case AUR_URLPATH:
-			return pkg->urlpath;
+			return &(pkg->urlpath);
 		case AUR_VERSION:
-			return pkg->version;
+			return &(pkg->version);
 		default:
 			return NULL;
 	}
 }
 
-static const alpm_list_t *aur_pkg_get_list_value (const aurpkg_t *pkg, aurkeytype_t key)
+static char *aur_pkg_get_string_value (const aurpkg_t *pkg, aurkeytype_t key)
+{
+	char **field = aur_pkg_str_field ((aurpkg_t *) pkg, key);
+	return (field) ? *field : NULL;
+}
+
+static aurlist_t *aur_pkg_list_field (aurpkg_t *pkg, aurkeytype_t key)
 {
 	if (!pkg) {
 		return NULL;
@@ -257,30 +228,41 @@ static const alpm_list_t *aur_pkg_get_list_value (const aurpkg_t *pkg, aurkeytyp
 
 	switch (key) {
 		case AUR_CHECKDEPENDS:
-			return pkg->checkdepends;
+			return &(pkg->checkdepends);
 		case AUR_CONFLICTS:
-			return pkg->conflicts;
+			return &(pkg->conflicts);
 		case AUR_DEPENDS:
-			return pkg->depends;
+			return &(pkg->depends);
 		case AUR_GROUPS:
-			return pkg->groups;
+			return &(pkg->groups);
 		case AUR_KEYWORDS:
-			return pkg->keywords;
+			return &(pkg->keywords);
 		case AUR_LICENSES:
-			return pkg->licenses;
+			return &(pkg->licenses);
 		case AUR_MAKEDEPENDS:
-			return pkg->makedepends;
+			return &(pkg->makedepends);
 		case AUR_OPTDEPENDS:
-			return pkg->optdepends;
+			return &(pkg->optdepends);
 		case AUR_PROVIDES:
-			return pkg->provides;
+			return &(pkg->provides);
 		case AUR_REPLACES:
-			return pkg->replaces;
+			return &(pkg->replaces);
 		default:
 			return NULL;
 	}
 }
 
+static const aurlist_t *aur_pkg_get_list_value (const aurpkg_t *pkg, aurkeytype_t key)
+{
+	return aur_pkg_list_field ((aurpkg_t *) pkg, key);
+}
+
+static char *aur_pkg_concat_list (const aurpkg_t *pkg, aurkeytype_t key)
+{
+	const aurlist_t *l = aur_pkg_get_list_value (pkg, key);
+	return (l) ? concat_str_array (l->data, l->count) : NULL;
+}
+
 static unsigned int aur_pkg_get_uint_value (const aurpkg_t *pkg, aurkeytype_t key)
 {
 	if (!pkg) {
@@ -351,8 +333,7 @@ static int json_start_map (void *ctx)
 
 	pkg_json->level++;
 	if (pkg_json->level > 1) {
-		aur_pkg_free (pkg_json->pkg);
-		pkg_json->pkg = aur_pkg_new ();
+		pkg_json->pkg = aur_pkg_new (pkg_json->arena);
 	}
 
 	return 1;
@@ -368,13 +349,48 @@ static int json_end_map (void *ctx)
 
 	pkg_json->level--;
 	if (pkg_json->level == 1 && pkg_json->pkg) {
-		alpm_list_fn_cmp fn_cmp = (config.sort == S_VOTE) ? aur_pkg_votes_cmp : aur_pkg_cmp;
-		pkg_json->pkgs = alpm_list_add_sorted (pkg_json->pkgs, pkg_json->pkg, fn_cmp);
+		/* sorted once the whole response is parsed */
+		if (pkg_json->pkgs_count == pkg_json->pkgs_size) {
+			pkg_json->pkgs_size = (pkg_json->pkgs_size) ? pkg_json->pkgs_size * 2 : 64;
+			REALLOC (pkg_json->pkgs, pkg_json->pkgs_size * sizeof (aurpkg_t *));
+		}
+		pkg_json->pkgs[pkg_json->pkgs_count++] = pkg_json->pkg;
 		pkg_json->pkg = NULL;
 	}
 	return 1;
 }
 
+static aurkeytype_t aur_key_lookup (const char *s, size_t len)
+{
+	static aurkeytype_t table[AUR_KEY_HASH_SIZE];
+	static size_t table_len[AUR_KEY_HASH_SIZE];
+	static bool table_init = false;
+
+	if (!table_init) {
+		for (aurkeytype_t i = AUR_NO_KEY + 1; i < AUR_KEY_COUNT; i++) {
+			const size_t l = strlen (aur_key_types_names[i]);
+			size_t h = AUR_KEY_HASH (aur_key_types_names[i], l);
+			while (table[h] != AUR_NO_KEY) {
+				h = (h + 1) & (AUR_KEY_HASH_SIZE - 1);
+			}
+			table[h] = i;
+			table_len[h] = l;
+		}
+		table_init = true;
+	}
+
+	if (len == 0) {
+		return AUR_NO_KEY;
+	}
+	for (size_t h = AUR_KEY_HASH (s, len); table[h] != AUR_NO_KEY;
+			h = (h + 1) & (AUR_KEY_HASH_SIZE - 1)) {
+		if (table_len[h] == len && memcmp (aur_key_types_names[table[h]], s, len) == 0) {
+			return table[h];
+		}
+	}
+	return AUR_KEY_COUNT;
+}
+
 static int json_key (void *ctx, const unsigned char *stringVal, size_t stringLen)
 {
 	jsonpkg_t *pkg_json = (jsonpkg_t *) ctx;
@@ -383,14 +399,10 @@ static int json_key (void *ctx, const unsigned char *stringVal, size_t stringLen
 		return 1;
 	}
 
-	stringLen = (stringLen >= AUR_ID_LEN) ? AUR_ID_LEN - 1 : stringLen;
-	for (int i = 0; i <= AUR_LAST_ID; ++i) {
-		if (strlen (aur_key_types_names[i]) == stringLen &&
-				strncmp (aur_key_types_names[i], (const char *) stringVal, stringLen) == 0) {
-			pkg_json->current_key = i;
-			break;
-		}
-	}
+	/* values of unknown keys (CoMaintainers...) are skipped, they must
+	 * not end up in the array of the previous key */
+	const aurkeytype_t key = aur_key_lookup ((const char *) stringVal, stringLen);
+	pkg_json->current_key = (key != AUR_KEY_COUNT) ? key : AUR_NO_KEY;
 
 	return 1;
 }
@@ -483,74 +495,55 @@ static int json_string (void *ctx, const unsigned char *stringVal, size_t string
 		return 1;
 	}
 
-	char *s = strndup ((const char *) stringVal, stringLen);
-	switch (pkg_json->current_key) {
-		case AUR_DESCRIPTION:
-			free (pkg_json->pkg->desc);
-			pkg_json->pkg->desc = s;
-			break;
-		case AUR_MAINTAINER:
-			free (pkg_json->pkg->maintainer);
-			pkg_json->pkg->maintainer = s;
-			break;
-		case AUR_NAME:
-			free (pkg_json->pkg->name);
-			pkg_json->pkg->name = s;
-			break;
-		case AUR_PKGBASE:
-			free (pkg_json->pkg->pkgbase);
-			pkg_json->pkg->pkgbase = s;
-			break;
-		case AUR_URL:
-			free (pkg_json->pkg->url);
-			pkg_json->pkg->url = s;
-			break;
-		case AUR_URLPATH:
-			free (pkg_json->pkg->urlpath);
-			pkg_json->pkg->urlpath = s;
-			break;
-		case AUR_VERSION:
-			free (pkg_json->pkg->version);
-			pkg_json->pkg->version = s;
-			break;
-		case AUR_CHECKDEPENDS:
-			pkg_json->pkg->checkdepends = alpm_list_add (pkg_json->pkg->checkdepends, s);
-			break;
-		case AUR_CONFLICTS:
-			pkg_json->pkg->conflicts = alpm_list_add (pkg_json->pkg->conflicts, s);
-			break;
-		case AUR_DEPENDS:
-			pkg_json->pkg->depends = alpm_list_add (pkg_json->pkg->depends, s);
-			break;
-		case AUR_GROUPS:
-			pkg_json->pkg->groups = alpm_list_add (pkg_json->pkg->groups, s);
-			break;
-		case AUR_KEYWORDS:
-			pkg_json->pkg->keywords = alpm_list_add (pkg_json->pkg->keywords, s);
-			break;
-		case AUR_LICENSES:
-			pkg_json->pkg->licenses = alpm_list_add (pkg_json->pkg->licenses, s);
-			break;
-		case AUR_MAKEDEPENDS:
-			pkg_json->pkg->makedepends = alpm_list_add (pkg_json->pkg->makedepends, s);
-			break;
-		case AUR_OPTDEPENDS:
-			pkg_json->pkg->optdepends = alpm_list_add (pkg_json->pkg->optdepends, s);
-			break;
-		case AUR_PROVIDES:
-			pkg_json->pkg->provides = alpm_list_add (pkg_json->pkg->provides, s);
-			break;
-		case AUR_REPLACES:
-			pkg_json->pkg->replaces = alpm_list_add (pkg_json->pkg->replaces, s);
-			break;
-		default:
-			free (s);
-			break;
+	char **field = aur_pkg_str_field (pkg_json->pkg, pkg_json->current_key);
+	if (!field && !aur_pkg_list_field (pkg_json->pkg, pkg_json->current_key)) {
+		return 1;
+	}
+
+	char *s = arena_strndup (pkg_json->arena, (const char *) stringVal, stringLen);
+	if (field) {
+		*field = s;
+		return 1;
+	}
+
+	/* array value, copied to the package on json_end_array() */
+	if (pkg_json->strs_count == pkg_json->strs_size) {
+		pkg_json->strs_size = (pkg_json->strs_size) ? pkg_json->strs_size * 2 : 16;
+		REALLOC (pkg_json->strs, pkg_json->strs_size * sizeof (char *));
 	}
+	pkg_json->strs[pkg_json->strs_count++] = s;
 
 	return 1;
 }
 
+static int json_start_array (void *ctx)
+{
+	jsonpkg_t *pkg_json = (jsonpkg_t *) ctx;
+
+	if (pkg_json) {
+		pkg_json->strs_count = 0;
+	}
+	return 1;
+}
+
+static int json_end_array (void *ctx)
+{
+	jsonpkg_t *pkg_json = (jsonpkg_t *) ctx;
+
+	if (!pkg_json || pkg_json->level < 2) {
+		return 1;
+	}
+
+	aurlist_t *l = aur_pkg_list_field (pkg_json->pkg, pkg_json->current_key);
+	if (l && pkg_json->strs_count) {
+		const size_t size = pkg_json->strs_count * sizeof (char *);
+		l->data = memcpy (arena_alloc (pkg_json->arena, size), pkg_json->strs, size);
+		l->count = pkg_json->strs_count;
+	}
+	pkg_json->strs_count = 0;
+	return 1;
+}
+
 static yajl_callbacks callbacks = {
     NULL,
     NULL,
@@ -561,25 +554,30 @@ static yajl_callbacks callbacks = {
     json_start_map,
     json_key,
     json_end_map,
-    NULL,
-    NULL,
+    json_start_array,
+    json_end_array,
 };
 
-static alpm_list_t *aur_json_parse (char *s, char *error)
+#ifdef USE_SIMD_JSON
+static bool aur_json_run (const char *s, size_t len, jsonpkg_t *pkg_json)
 {
-	if (!s) {
-		return NULL;
+	size_t offset;
+	const char *err = json_scan (&callbacks, pkg_json, s, len, &offset);
+	if (err) {
+		fprintf(stderr, "parse error: %s (at offset %zu)\n", err, offset);
+		return false;
 	}
-
+	return true;
+}
+#else
+static bool aur_json_run (const char *s, size_t len, jsonpkg_t *pkg_json)
+{
 	// this setlocale() hack is a workaround for the yajl issue:
 	// https://github.com/lloyd/yajl/issues/79
 	setlocale (LC_ALL, "C");
 
-	const size_t len = strlen (s);
-	jsonpkg_t pkg_json = {NULL, NULL, 0, false, NULL, 0};
-	yajl_handle hand = yajl_alloc (&callbacks, NULL, (void *) &pkg_json);
+	yajl_handle hand = yajl_alloc (&callbacks, NULL, (void *) pkg_json);
 	yajl_status stat = yajl_parse (hand, (const unsigned char *) s, len);
-
 	if (stat == yajl_status_ok) {
 		stat = yajl_complete_parse (hand);
 	}
@@ -587,12 +585,42 @@ static alpm_list_t *aur_json_parse (char *s, char *error)
 		unsigned char *str = yajl_get_error (hand, 1, (const unsigned char *) s, len);
 		fprintf(stderr, "%s\n", (const char *) str);
 		yajl_free_error (hand, str);
-		alpm_list_free_inner (pkg_json.pkgs, (alpm_list_fn_free) aur_pkg_free);
-		alpm_list_free (pkg_json.pkgs);
-		pkg_json.pkgs = NULL;
 	}
-
 	yajl_free (hand);
+
+	setlocale (LC_ALL, "");
+	return (stat == yajl_status_ok);
+}
+#endif
+
+aurresponse_t *aur_response_parse (const char *s, size_t len, char *error)
+{
+	const uint64_t probe_start = PROBE_START (aur_json_parse);
+	jsonpkg_t pkg_json = {0};
+	pkg_json.arena = arena_new (AUR_ARENA_SIZE);
+	aurresponse_t *res = NULL;
+
+	stats_begin (ST_JSON, NULL);
+	const bool parsed = aur_json_run (s, len, &pkg_json);
+	stats_end ();
+	if (!parsed) {
+		arena_free (pkg_json.arena);
+	} else {
+		stats_count (SC_SCANNED, pkg_json.pkgs_count);
+		const size_t size = pkg_json.pkgs_count * sizeof (aurpkg_t *);
+		res = arena_alloc (pkg_json.arena, sizeof (aurresponse_t));
+		res->arena = pkg_json.arena;
+		res->pkgs = arena_alloc (pkg_json.arena, size);
+		res->count = pkg_json.pkgs_count;
+		if (size) {
+			memcpy (res->pkgs, pkg_json.pkgs, size);
+		}
+		array_msort (res->pkgs, res->count, sizeof (aurpkg_t *),
+				(config.sort == S_VOTE) ? aur_pkg_votes_cmp : aur_pkg_cmp);
+	}
+
+	FREE (pkg_json.pkgs);
+	FREE (pkg_json.strs);
 	if (pkg_json.error) {
 		if (error) {
 			strcpy (error, pkg_json.error_msg);
@@ -602,10 +630,29 @@ static alpm_list_t *aur_json_parse (char *s, char *error)
 		FREE (pkg_json.error_msg);
 	}
 
-	setlocale (LC_ALL, "");
-	free (s);
+	PROBE_DONE2 (aur_json_parse, probe_start, len, (res) ? res->count : 0);
+	return res;
+}
 
-	return pkg_json.pkgs;
+size_t aur_response_count (const aurresponse_t *res)
+{
+	return (res) ? res->count : 0;
+}
+
+const aurpkg_t *aur_response_pkg (const aurresponse_t *res, size_t i)
+{
+	return (res && i < res->count) ? res->pkgs[i] : NULL;
+}
+
+/* Parse and free s */
+static aurresponse_t *aur_json_parse (char *s, char *error)
+{
+	if (!s) {
+		return NULL;
+	}
+	aurresponse_t *res = aur_response_parse (s, strlen (s), error);
+	FREE (s);
+	return res;
 }
 
 static string_t *aur_prepare_url (const char *aur_rpc_type)
@@ -620,10 +667,10 @@ static string_t *aur_prepare_url (const char *aur_rpc_type)
 
 static unsigned int aur_request_search (alpm_list_t **targets, CURL *curl)
 {
-	alpm_list_t *pkgs = NULL;
+	aurresponse_t *res = NULL;
 	char error[256] = {0};
 
-	for (const alpm_list_t *t = *targets; !pkgs; t = alpm_list_next (*targets)) {
+	for (const alpm_list_t *t = *targets; !res; t = alpm_list_next (*targets)) {
 		char *encoded_arg = NULL;
 		if (t) {
 			encoded_arg = curl_easy_escape (curl, t->data, 0);
@@ -646,17 +693,26 @@ static unsigned int aur_request_search (alpm_list_t **targets, CURL *curl)
 			break; // stop on any curl error
 		}
 
-		pkgs = aur_json_parse (curl_res, error);
+		res = aur_json_parse (curl_res, error);
+		if (res && !res->count) {
+			aur_response_free (res);
+			res = NULL;
+		}
 	}
 
-	if (!pkgs && error[0] != '\0') {
+	if (!res && error[0] != '\0') {
 		fprintf(stderr, "AUR error : %s\n", error);
 	}
 
+	/* matching packages may be kept by the results */
+	if (res) {
+		results_own_arena (res->arena);
+	}
+
 	unsigned int pkgs_found = 0;
-	for (const alpm_list_t *p = pkgs; p; p = alpm_list_next (p)) {
+	for (size_t i = 0; res && i < res->count; i++) {
 		bool match = true;
-		const aurpkg_t *pkg = p->data;
+		const aurpkg_t *pkg = res->pkgs[i];
 
 		if (!config.aur_maintainer) {
 			const char *pkgname = aur_pkg_get_string_value (pkg, AUR_NAME);
@@ -676,8 +732,7 @@ static unsigned int aur_request_search (alpm_list_t **targets, CURL *curl)
 		}
 	}
 
-	alpm_list_free_inner (pkgs, (alpm_list_fn_free) aur_pkg_free);
-	alpm_list_free (pkgs);
+	results_release_arena ();
 
 	return pkgs_found;
 }
@@ -720,11 +775,11 @@ static unsigned int aur_request_info (alpm_list_t **targets, CURL *curl)
 			break;
 		}
 
-		alpm_list_t *pkgs = aur_json_parse (curl_fetch (curl, string_cstr (url)), NULL);
+		aurresponse_t *res = aur_json_parse (curl_fetch (curl, string_cstr (url)), NULL);
 		string_free (url);
 
-		for (const alpm_list_t *p = pkgs; p; p = alpm_list_next (p)) {
-			const aurpkg_t *pkg = p->data;
+		for (size_t i = 0; res && i < res->count; i++) {
+			const aurpkg_t *pkg = res->pkgs[i];
 			const char *pkgname = aur_pkg_get_string_value (pkg, AUR_NAME);
 			const char *pkgver = aur_pkg_get_string_value (pkg, AUR_VERSION);
 			const target_t *one_target = alpm_list_find (real_targets,
@@ -743,8 +798,7 @@ static unsigned int aur_request_info (alpm_list_t **targets, CURL *curl)
 			}
 		}
 
-		alpm_list_free_inner (pkgs, (alpm_list_fn_free) aur_pkg_free);
-		alpm_list_free (pkgs);
+		aur_response_free (res);
 	}
 
 	/* target_arg_close() must be called before freeing real_targets */
@@ -817,7 +871,7 @@ static char *aur_get_arch (const aurpkg_t *pkg)
 		if (res) {
 			alpm_list_t *arch_list = read_pkgbuild_field (res, "arch=('");
 			arch = concat_str_list (arch_list);
-			free (res);
+			FREE (res);
 			FREELIST (arch_list);
 		}
 	}
@@ -830,124 +884,92 @@ static char *aur_get_arch (const aurpkg_t *pkg)
 const char *aur_get_str (const void *p, unsigned char c)
 {
 	const aurpkg_t *pkg = (const aurpkg_t *) p;
-	static char *info = NULL;
-	static bool free_info = false;
-	if (free_info) {
-		free (info);
-		free_info = false;
-	}
-	info = NULL;
+	char *info = NULL;
 	switch (c) {
 		case 'a':
 			info = aur_get_arch (pkg);
-			free_info = true;
 			break;
 		case 'b':
 			info = aur_pkg_get_string_value (pkg, AUR_PKGBASE);
 			break;
 		case 'c':
-			info = concat_str_list (aur_pkg_get_list_value (pkg, AUR_CHECKDEPENDS));
-			free_info = true;
+			info = aur_pkg_concat_list (pkg, AUR_CHECKDEPENDS);
 			break;
 		case 'C':
-			info = concat_str_list (aur_pkg_get_list_value (pkg, AUR_CONFLICTS));
-			free_info = true;
+			info = aur_pkg_concat_list (pkg, AUR_CONFLICTS);
 			break;
 		case 'd':
 			info = aur_pkg_get_string_value (pkg, AUR_DESCRIPTION);
 			break;
 		case 'D':
-			info = concat_str_list (aur_pkg_get_list_value (pkg, AUR_DEPENDS));
-			free_info = true;
+			info = aur_pkg_concat_list (pkg, AUR_DEPENDS);
 			break;
 		case 'e':
-			info = concat_str_list (aur_pkg_get_list_value (pkg, AUR_LICENSES));
-			free_info = true;
+			info = aur_pkg_concat_list (pkg, AUR_LICENSES);
 			break;
 		case 'g':
-			info = concat_str_list (aur_pkg_get_list_value (pkg, AUR_GROUPS));
-			free_info = true;
+			info = aur_pkg_concat_list (pkg, AUR_GROUPS);
 			break;
 		case 'G':
 			{
 				const char *pkgbase = aur_pkg_get_string_value (pkg, AUR_PKGBASE);
 				if (config.aur_url && pkgbase) {
-					int ret = asprintf (&info, "%s/%s.git", config.aur_url, pkgbase);
-					if (ret < 0) {
-						FREE (info);
-					} else {
-						free_info = true;
-					}
+					info = record_strjoin (config.aur_url, "/", pkgbase, ".git", NULL);
 				}
 			}
 			break;
 		case 'i':
 			info = itostr (aur_pkg_get_uint_value (pkg, AUR_ID));
-			free_info = true;
 			break;
 		case 'k':
 			info = itostr (aur_pkg_get_uint_value (pkg, AUR_PKGBASE_ID));
-			free_info = true;
 			break;
 		case 'K':
-			info = concat_str_list (aur_pkg_get_list_value (pkg, AUR_KEYWORDS));
-			free_info = true;
+			info = aur_pkg_concat_list (pkg, AUR_KEYWORDS);
 			break;
 		case 'm':
 			info = aur_pkg_get_string_value (pkg, AUR_MAINTAINER);
 			break;
 		case 'M':
-			info = concat_str_list (aur_pkg_get_list_value (pkg, AUR_MAKEDEPENDS));
-			free_info = true;
+			info = aur_pkg_concat_list (pkg, AUR_MAKEDEPENDS);
 			break;
 		case 'n':
 			info = aur_pkg_get_string_value (pkg, AUR_NAME);
 			break;
 		case 'L':
 			info = ttostr (aur_pkg_get_time_value (pkg, AUR_LAST));
-			free_info = true;
 			break;
 		case 'o':
 			info = itostr (aur_pkg_get_outofdate (pkg));
-			free_info = true;
 			break;
 		case 'O':
-			info = concat_str_list (aur_pkg_get_list_value (pkg, AUR_OPTDEPENDS));
-			free_info = true;
+			info = aur_pkg_concat_list (pkg, AUR_OPTDEPENDS);
 			break;
 		case 'p':
 			{
-				int ret = asprintf (&info, "%.2f", aur_pkg_get_popularity (pkg));
-				if (ret < 0) {
-					FREE (info);
-				} else {
-					free_info = true;
+				char buf[64];
+				const int len = snprintf (buf, sizeof (buf), "%.2f", aur_pkg_get_popularity (pkg));
+				if (len > 0 && (size_t) len < sizeof (buf)) {
+					info = record_alloc (len + 1);
+					memcpy (info, buf, len + 1);
 				}
 			}
 			break;
 		case 'P':
-			info = concat_str_list (aur_pkg_get_list_value (pkg, AUR_PROVIDES));
-			free_info = true;
+			info = aur_pkg_concat_list (pkg, AUR_PROVIDES);
 			break;
 		case 's':
 		case 'r':
-			info = strdup (AUR_REPO);
-			free_info = true;
+			info = (char *) AUR_REPO;
 			break;
 		case 'R':
-			info = concat_str_list (aur_pkg_get_list_value (pkg, AUR_REPLACES));
-			free_info = true;
+			info = aur_pkg_concat_list (pkg, AUR_REPLACES);
 			break;
 		case 'u':
 			{
 				const char *urlpath = aur_pkg_get_string_value (pkg, AUR_URLPATH);
 				if (config.aur_url && urlpath) {
-					int ret = asprintf (&info, "%s%s", config.aur_url, urlpath);
-					if (ret < 0) {
-						FREE (info);
-					} else {
-						free_info = true;
-					}
+					info = record_strjoin (config.aur_url, urlpath, NULL);
 				}
 			}
 			break;
@@ -956,7 +978,6 @@ const char *aur_get_str (const void *p, unsigned char c)
 			break;
 		case 'S':
 			info = ttostr (aur_pkg_get_time_value (pkg, AUR_FIRST));
-			free_info = true;
 			break;
 		case 'V':
 		case 'v':
@@ -964,7 +985,6 @@ const char *aur_get_str (const void *p, unsigned char c)
 			break;
 		case 'w':
 			info = itostr (aur_pkg_get_uint_value (pkg, AUR_NUMVOTES));
-			free_info = true;
 			break;
 		default:
 			return NULL;
@@ -972,9 +992,40 @@ const char *aur_get_str (const void *p, unsigned char c)
 	return info;
 }
 
-void aur_cleanup (void)
+static void aur_pkg_json_list (yajl_gen g, const char *key, const aurpkg_t *pkg, aurkeytype_t k)
+{
+	const aurlist_t *l = aur_pkg_get_list_value (pkg, k);
+	json_gen_str_array (g, key, (l) ? l->data : NULL, (l) ? l->count : 0);
+}
+
+void aur_pkg_json (yajl_gen g, const aurpkg_t *pkg)
 {
-	aur_get_str (NULL, 0);
+	json_gen_int (g, "id", aur_pkg_get_uint_value (pkg, AUR_ID));
+	json_gen_str (g, "name", aur_pkg_get_string_value (pkg, AUR_NAME));
+	json_gen_int (g, "base_id", aur_pkg_get_uint_value (pkg, AUR_PKGBASE_ID));
+	json_gen_str (g, "base", aur_pkg_get_string_value (pkg, AUR_PKGBASE));
+	json_gen_str (g, "version", aur_pkg_get_string_value (pkg, AUR_VERSION));
+	json_gen_str (g, "description", aur_pkg_get_string_value (pkg, AUR_DESCRIPTION));
+	json_gen_str (g, "url", aur_pkg_get_string_value (pkg, AUR_URL));
+	json_gen_str (g, "tarball_url", aur_get_str (pkg, 'u'));
+	json_gen_str (g, "git_url", aur_get_str (pkg, 'G'));
+	json_gen_str (g, "maintainer", aur_pkg_get_string_value (pkg, AUR_MAINTAINER));
+	json_gen_str (g, "repository", AUR_REPO);
+	json_gen_int (g, "votes", aur_pkg_get_uint_value (pkg, AUR_NUMVOTES));
+	json_gen_double (g, "popularity", aur_pkg_get_popularity (pkg));
+	json_gen_bool (g, "outofdate", aur_pkg_get_outofdate (pkg));
+	json_gen_int (g, "firstsubmit", aur_pkg_get_time_value (pkg, AUR_FIRST));
+	json_gen_int (g, "lastmod", aur_pkg_get_time_value (pkg, AUR_LAST));
+	aur_pkg_json_list (g, "licenses", pkg, AUR_LICENSES);
+	aur_pkg_json_list (g, "groups", pkg, AUR_GROUPS);
+	aur_pkg_json_list (g, "keywords", pkg, AUR_KEYWORDS);
+	aur_pkg_json_list (g, "depends", pkg, AUR_DEPENDS);
+	aur_pkg_json_list (g, "makedepends", pkg, AUR_MAKEDEPENDS);
+	aur_pkg_json_list (g, "checkdepends", pkg, AUR_CHECKDEPENDS);
+	aur_pkg_json_list (g, "optdepends", pkg, AUR_OPTDEPENDS);
+	aur_pkg_json_list (g, "conflicts", pkg, AUR_CONFLICTS);
+	aur_pkg_json_list (g, "provides", pkg, AUR_PROVIDES);
+	aur_pkg_json_list (g, "replaces", pkg, AUR_REPLACES);
 }
 
 /* vim: set ts=4 sw=4 noet: */
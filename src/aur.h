@@ -20,6 +20,16 @@
 #define PQ_AUR_H
 #include <stdbool.h>
 #include <alpm_list.h>
+#include <yajl/yajl_gen.h>
+
+/*
+ * AUR string array (depends, licenses...)
+ */
+typedef struct _aurlist_t
+{
+	const char **data;
+	size_t count;
+} aurlist_t;
 
 /*
  * AUR package
@@ -34,16 +44,16 @@ typedef struct _aurpkg_t
 	char *urlpath;
 	char *version;
 
-	alpm_list_t *checkdepends;
-	alpm_list_t *conflicts;
-	alpm_list_t *depends;
-	alpm_list_t *groups;
-	alpm_list_t *keywords;
-	alpm_list_t *licenses;
-	alpm_list_t *makedepends;
-	alpm_list_t *optdepends;
-	alpm_list_t *provides;
-	alpm_list_t *replaces;
+	aurlist_t checkdepends;
+	aurlist_t conflicts;
+	aurlist_t depends;
+	aurlist_t groups;
+	aurlist_t keywords;
+	aurlist_t licenses;
+	aurlist_t makedepends;
+	aurlist_t optdepends;
+	aurlist_t provides;
+	aurlist_t replaces;
 
 	unsigned int id;
 	unsigned int pkgbase_id;
@@ -65,8 +75,18 @@ typedef enum {
 	AUR_SEARCH = 2
 } aurrequest_t;
 
-void aur_pkg_free (aurpkg_t *pkg);
-aurpkg_t *aur_pkg_dup (const aurpkg_t *pkg);
+/*
+ * Packages of one RPC response, sorted by name (or votes with
+ * --sort vote). aur_response_parse() returns NULL if s is not a valid
+ * response, the error message of the AUR is copied to error if given,
+ * printed otherwise.
+ */
+typedef struct _aurresponse_t aurresponse_t;
+
+aurresponse_t *aur_response_parse (const char *s, size_t len, char *error);
+size_t aur_response_count (const aurresponse_t *res);
+const aurpkg_t *aur_response_pkg (const aurresponse_t *res, size_t i);
+void aur_response_free (aurresponse_t *res);
 
 const char *aur_pkg_get_name (const aurpkg_t *pkg);
 unsigned int aur_pkg_get_votes (const aurpkg_t *pkg);
@@ -80,11 +100,15 @@ unsigned int aur_request (alpm_list_t **targets, aurrequest_t type);
 
 /*
  * aur_get_str() get info for package
- * str returned should not be passed to free
+ * str returned lives in the record arena and should not be passed to free
  */
 const char *aur_get_str (const void *p, unsigned char c);
 
-void aur_cleanup (void);
+/*
+ * aur_pkg_json() adds package fields to the current JSON object
+ * %a (needs to fetch the PKGBUILD) is left out.
+ */
+void aur_pkg_json (yajl_gen g, const aurpkg_t *pkg);
 
 #endif
 
@@ -16,6 +16,7 @@
  *  You should have received a copy of the GNU General Public License
  *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include "config.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -29,64 +30,114 @@
 #define COL_VAL(x)     ((x >= '0' && x <= '9') || x == ';')
 #define COLOR          "0123456789;"
 
+/* PQ_COLORS keys of colorid_t */
+static const char *color_names[C_LAST] =
+{
+	"no",
+	"nb",
+	"other",
+	"pkg",
+	"ver",
+	"installed",
+	"lver",
+	"grp",
+	"od",
+	"votes",
+	"popularity",
+	"dsc",
+	"orphan"
+};
+
+/* Every key parsed from PQ_COLORS, in an open addressing hash table */
 typedef struct _colors_t
 {
 	char *id;
 	char *color;
+	unsigned long hash;
 } colors_t;
 
-static alpm_list_t *colors = NULL;
+#define COLORS_MIN_SIZE 32
+
+static colors_t *colors = NULL;
+static size_t colors_size = 0;
+static size_t colors_count = 0;
+
+/* Escape sequences of colorid_t, resolved by color_init() */
+static const char *colors_id[C_LAST];
 
-static void colors_free (colors_t *c)
+/* FNV-1a */
+static unsigned long colors_hash (const char *id)
 {
-	FREE (c->id);
-	FREE (c->color);
-	FREE (c);
+	unsigned long h = 2166136261UL;
+	for (const unsigned char *c = (const unsigned char *) id; *c; c++) {
+		h = (h ^ *c) * 16777619UL;
+	}
+	return h;
 }
 
-static int colors_cmp (const void *c1, const void *c2)
+static colors_t *colors_find (const char *id, unsigned long hash)
 {
-	if (!c1 || !c2) {
-		return 0;
+	if (!colors) {
+		return NULL;
 	}
-
-	const char *c1id = ((const colors_t *) c1)->id;
-	const char *c2id = ((const colors_t *) c2)->id;
-	if (!c1id || !c2id) {
-		return 0;
+	for (size_t i = hash & (colors_size - 1); colors[i].id; i = (i + 1) & (colors_size - 1)) {
+		if (colors[i].hash == hash && strcmp (colors[i].id, id) == 0) {
+			return &(colors[i]);
+		}
 	}
-
-	return strcmp (c1id, c2id);
+	return NULL;
 }
 
-static int colors_cmp_id (const void *c1, const void *id)
+static colors_t *colors_insert (char *id, unsigned long hash)
 {
-	if (!c1 || !id) {
-		return 0;
+	size_t i = hash & (colors_size - 1);
+	while (colors[i].id) {
+		i = (i + 1) & (colors_size - 1);
 	}
+	colors[i].id = id;
+	colors[i].hash = hash;
+	colors_count++;
+	return &(colors[i]);
+}
 
-	const char *c1id = ((const colors_t *) c1)->id;
-	if (!c1id) {
-		return -1;
+static void colors_grow (void)
+{
+	colors_t *old = colors;
+	const size_t old_size = colors_size;
+	colors_size = (colors_size) ? colors_size * 2 : COLORS_MIN_SIZE;
+	colors_count = 0;
+	CALLOC (colors, colors_size, sizeof (colors_t));
+	for (size_t i = 0; i < old_size; i++) {
+		if (old[i].id) {
+			colors_insert (old[i].id, old[i].hash)->color = old[i].color;
+		}
 	}
-
-	return strcmp (c1id, (const char *) id);
+	FREE (old);
 }
 
 static void colors_set_color (const char *id, const char *color)
 {
-	colors_t *c = alpm_list_find (colors, id, colors_cmp_id);
+	const unsigned long hash = colors_hash (id);
+	colors_t *c = colors_find (id, hash);
 	if (c) {
-		free (c->color);
+		FREE (c->color);
 	} else {
-		MALLOC (c, sizeof (colors_t));
-		c->id = strdup (id);
-		colors = alpm_list_add_sorted (colors, c, colors_cmp);
+		/* keep the load factor under 1/2 */
+		if ((colors_count + 1) * 2 > colors_size) {
+			colors_grow ();
+		}
+		c = colors_insert (strdup (id), hash);
 	}
 	CALLOC (c->color, (strlen (color) + 4), sizeof (char)); /* + "\033[m" */
 	sprintf (c->color, "\033[%sm", color);
 }
 
+static const char *colors_get (const char *id)
+{
+	const colors_t *c = colors_find (id, colors_hash (id));
+	return (c) ? c->color : NULL;
+}
+
 static void parse_var (const char *s)
 {
 	if (!s) {
@@ -122,31 +173,37 @@ void color_init (void)
 {
 	parse_var (DEFAULT_COLORS);
 	parse_var (getenv (COLOR_ENV_VAR));
+	for (int i = 0; i < C_LAST; i++) {
+		const char *c = colors_get (color_names[i]);
+		colors_id[i] = (c) ? c : "";
+	}
 }
 
 void color_cleanup (void)
 {
-	if (colors) {
-		alpm_list_free_inner (colors, (alpm_list_fn_free) colors_free);
-		alpm_list_free (colors);
+	for (size_t i = 0; i < colors_size; i++) {
+		FREE (colors[i].id);
+		FREE (colors[i].color);
 	}
+	FREE (colors);
+	colors_size = colors_count = 0;
 }
 
-const char *color (const char *col)
+const char *color (colorid_t col)
 {
-	if (config.colors) {
-		const colors_t *c = alpm_list_find (colors, col, colors_cmp_id);
-		if (c) {
-			return c->color;
-		}
+	if (config.colors && colors_id[col]) {
+		return colors_id[col];
 	}
 	return "";
 }
 
 const char *color_repo (const char *repo)
 {
-	const char *res = color (repo);
-	if (*res != '\0') {
+	if (!config.colors) {
+		return "";
+	}
+	const char *res = colors_get (repo);
+	if (res && *res != '\0') {
 		return res;
 	}
 
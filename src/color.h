@@ -19,23 +19,30 @@
 #ifndef PQ_COLOR_H
 #define PQ_COLOR_H
 
-#define C_NB        "nb"
-#define C_OTHER     "other"
-#define C_PKG       "pkg"
-#define C_VER       "ver"
-#define C_INSTALLED "installed"
-#define C_LVER      "lver"
-#define C_GRP       "grp"
-#define C_OD        "od"
-#define C_VOTES     "votes"
-#define C_POPUL     "popularity"
-#define C_DSC       "dsc"
-#define C_ORPHAN    "orphan"
-#define C_NO        "no"
+/*
+ * Color ids, see color_names in color.c for their PQ_COLORS key
+ */
+typedef enum
+{
+	C_NO = 0,
+	C_NB,
+	C_OTHER,
+	C_PKG,
+	C_VER,
+	C_INSTALLED,
+	C_LVER,
+	C_GRP,
+	C_OD,
+	C_VOTES,
+	C_POPUL,
+	C_DSC,
+	C_ORPHAN,
+	C_LAST
+} colorid_t;
 
 void color_init (void);
 void color_cleanup (void);
-const char *color (const char *col);
+const char *color (colorid_t col);
 const char *color_repo (const char *repo);
 
 #endif
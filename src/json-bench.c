@@ -0,0 +1,261 @@
+/*
+ *  json-bench.c
+ *
+ *  Copyright (c) 2010-2012 Tuxce <tuxce.net@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Compare the JSON backends on RPC responses:
+ *   json-bench [-n iterations] response.json...
+ * Both parsers feed the same callbacks, which hash the events they
+ * get, so that a difference in output is reported along with speed.
+ * Both must also reject strings with invalid UTF-8, checked first.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <locale.h>
+#include <time.h>
+#include <yajl/yajl_parse.h>
+
+#include "jsonscan.h"
+
+typedef struct _bench_t
+{
+	uint64_t hash;
+	size_t events;
+} bench_t;
+
+static void bench_add (bench_t *b, int type, const void *data, size_t len)
+{
+	const unsigned char *p = data;
+	b->hash = (b->hash ^ type) * 1099511628211ULL;
+	for (size_t i = 0; i < len; i++) {
+		b->hash = (b->hash ^ p[i]) * 1099511628211ULL;
+	}
+	b->events++;
+}
+
+static int bench_null (void *ctx)
+{
+	bench_add (ctx, 'n', NULL, 0);
+	return 1;
+}
+
+static int bench_boolean (void *ctx, int val)
+{
+	bench_add (ctx, 'b', &val, sizeof (val));
+	return 1;
+}
+
+static int bench_integer (void *ctx, long long val)
+{
+	bench_add (ctx, 'i', &val, sizeof (val));
+	return 1;
+}
+
+static int bench_double (void *ctx, double val)
+{
+	bench_add (ctx, 'd', &val, sizeof (val));
+	return 1;
+}
+
+static int bench_string (void *ctx, const unsigned char *val, size_t len)
+{
+	bench_add (ctx, 's', val, len);
+	return 1;
+}
+
+static int bench_start_map (void *ctx)
+{
+	bench_add (ctx, '{', NULL, 0);
+	return 1;
+}
+
+static int bench_map_key (void *ctx, const unsigned char *val, size_t len)
+{
+	bench_add (ctx, 'k', val, len);
+	return 1;
+}
+
+static int bench_end_map (void *ctx)
+{
+	bench_add (ctx, '}', NULL, 0);
+	return 1;
+}
+
+static int bench_start_array (void *ctx)
+{
+	bench_add (ctx, '[', NULL, 0);
+	return 1;
+}
+
+static int bench_end_array (void *ctx)
+{
+	bench_add (ctx, ']', NULL, 0);
+	return 1;
+}
+
+static yajl_callbacks callbacks = {
+	bench_null,
+	bench_boolean,
+	bench_integer,
+	bench_double,
+	NULL,
+	bench_string,
+	bench_start_map,
+	bench_map_key,
+	bench_end_map,
+	bench_start_array,
+	bench_end_array,
+};
+
+/* Same work as aur_json_parse() with each backend */
+static int bench_yajl (const char *s, size_t len, bench_t *b)
+{
+	setlocale (LC_ALL, "C");
+	yajl_handle hand = yajl_alloc (&callbacks, NULL, b);
+	yajl_status stat = yajl_parse (hand, (const unsigned char *) s, len);
+	if (stat == yajl_status_ok) {
+		stat = yajl_complete_parse (hand);
+	}
+	yajl_free (hand);
+	setlocale (LC_ALL, "");
+	return (stat == yajl_status_ok);
+}
+
+static int bench_scan (const char *s, size_t len, bench_t *b)
+{
+	return (json_scan (&callbacks, b, s, len, NULL) == NULL);
+}
+
+/* Invalid after the first 16 bytes too, for the SSE2 path of jsonscan */
+static const char *invalid_utf8[] = {
+	"{\"Name\":\"\xff\"}",
+	"{\"Name\":\"caf\xc3\"}",
+	"{\"Name\":\"\xe2\x28\xa1\"}",
+	"{\"Description\":\"0123456789abcdef\xe2\x82\"}",
+	"{\"Description\":\"0123456789abcdef\\n\xf0\x28\x8c\xbc\"}",
+	"{\"0123456789abcdef\x80\":1}",
+};
+
+static const char *valid_utf8 =
+	"{\"Description\":\"0123456789abcdef caf\xc3\xa9 \xe2\x82\xac\\n\xf0\x9f\x98\x80\"}";
+
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static char *read_file (const char *path, size_t *len)
+{
+	FILE *f = fopen (path, "rb");
+	if (!f) {
+		perror (path);
+		return NULL;
+	}
+	size_t size = 65536, n = 0, r;
+	char *buf = malloc (size + 1);
+	while (buf && (r = fread (buf + n, 1, size - n, f)) > 0) {
+		n += r;
+		if (n == size) {
+			size *= 2;
+			buf = realloc (buf, size + 1);
+		}
+	}
+	fclose (f);
+	if (buf) {
+		buf[n] = '\0';
+		*len = n;
+	}
+	return buf;
+}
+
+int main (int argc, char **argv)
+{
+	static const struct {
+		const char *name;
+		int (*parse) (const char *, size_t, bench_t *);
+	} backends[] = {
+		{"yajl", bench_yajl},
+		{"simd", bench_scan},
+	};
+	int iterations = 100, opt, ret = 0;
+
+	setlocale (LC_ALL, "");
+	while ((opt = getopt (argc, argv, "n:")) != -1) {
+		if (opt == 'n') {
+			iterations = atoi (optarg);
+		} else {
+			fprintf (stderr, "usage: %s [-n iterations] response.json...\n", argv[0]);
+			return 1;
+		}
+	}
+
+	for (size_t j = 0; j < 2; j++) {
+		bench_t b = {0, 0};
+		if (!backends[j].parse (valid_utf8, strlen (valid_utf8), &b)) {
+			fprintf (stderr, "%s: valid UTF-8 rejected\n", backends[j].name);
+			ret = 1;
+		}
+		for (size_t k = 0; k < sizeof (invalid_utf8) / sizeof (invalid_utf8[0]); k++) {
+			if (backends[j].parse (invalid_utf8[k], strlen (invalid_utf8[k]), &b)) {
+				fprintf (stderr, "%s: invalid UTF-8 #%zu accepted\n", backends[j].name, k);
+				ret = 1;
+			}
+		}
+	}
+
+	printf ("%-24s %-6s %10s %10s %10s\n", "file", "parser", "events", "ms/parse", "MB/s");
+	for (int i = optind; i < argc; i++) {
+		size_t len;
+		char *s = read_file (argv[i], &len);
+		if (!s) {
+			ret = 1;
+			continue;
+		}
+		uint64_t hash[2];
+		for (size_t j = 0; j < 2; j++) {
+			bench_t b = {14695981039346656037ULL, 0};
+			if (!backends[j].parse (s, len, &b)) {
+				fprintf (stderr, "%s: %s parse failed\n", argv[i], backends[j].name);
+				ret = 1;
+			}
+			hash[j] = b.hash;
+			const double start = now ();
+			for (int k = 0; k < iterations; k++) {
+				bench_t t = {0, 0};
+				backends[j].parse (s, len, &t);
+			}
+			const double per = (now () - start) / (iterations ? iterations : 1);
+			printf ("%-24s %-6s %10zu %10.3f %10.1f\n", argv[i], backends[j].name,
+					b.events, per * 1e3, len / per / 1e6);
+		}
+		if (hash[0] != hash[1]) {
+			fprintf (stderr, "%s: backends disagree\n", argv[i]);
+			ret = 1;
+		}
+		free (s);
+	}
+	return ret;
+}
+
+/* vim: set ts=4 sw=4 noet: */
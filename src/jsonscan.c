@@ -0,0 +1,511 @@
+/*
+ *  jsonscan.c
+ *
+ *  Copyright (c) 2010-2012 Tuxce <tuxce.net@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <locale.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "util.h"
+#include "jsonscan.h"
+
+/*
+ * Recursive descent JSON parser. Most of the bytes of an RPC response
+ * are string contents, they are skipped 16 at a time looking for the
+ * closing quote. Non-ASCII bytes stop the skip to be validated as UTF-8
+ * like yajl does.
+ */
+
+#define JSCAN_MAX_DEPTH 1024
+#define JSCAN_NUM_LEN 64
+
+typedef struct _jscan_t
+{
+	const yajl_callbacks *cb;
+	void *ctx;
+	const unsigned char *p;
+	const unsigned char *end;
+	const char *error;
+	int depth;
+	/* unescaped strings */
+	unsigned char *buf;
+	size_t buf_len;
+	size_t buf_size;
+} jscan_t;
+
+/* Call a callback if set, false if it cancelled the parse */
+#define JSCAN_CB(s, fn, ...) \
+	(!(s)->cb->fn || (s)->cb->fn ((s)->ctx, ##__VA_ARGS__) \
+	 || jscan_error ((s), "client cancelled parse"))
+
+static bool jscan_error (jscan_t *s, const char *error)
+{
+	if (!s->error) {
+		s->error = error;
+	}
+	return false;
+}
+
+static void jscan_ws (jscan_t *s)
+{
+	while (s->p < s->end && (*s->p == ' ' || *s->p == '\n'
+				|| *s->p == '\r' || *s->p == '\t')) {
+		s->p++;
+	}
+}
+
+/* First '"', '\\', control character or non-ASCII byte from p */
+static const unsigned char *jscan_string_stop (const unsigned char *p, const unsigned char *end)
+{
+#ifdef __SSE2__
+	const __m128i quote = _mm_set1_epi8 ('"');
+	const __m128i bslash = _mm_set1_epi8 ('\\');
+	const __m128i ctrl = _mm_set1_epi8 (0x1f);
+	while (end - p >= 16) {
+		const __m128i v = _mm_loadu_si128 ((const __m128i *) p);
+		const __m128i stop = _mm_or_si128 (
+				_mm_or_si128 (_mm_cmpeq_epi8 (v, quote), _mm_cmpeq_epi8 (v, bslash)),
+				/* v <= 0x1f, unsigned */
+				_mm_cmpeq_epi8 (_mm_min_epu8 (v, ctrl), v));
+		/* the sign bit of v is set for non-ASCII bytes */
+		const int mask = _mm_movemask_epi8 (stop) | _mm_movemask_epi8 (v);
+		if (mask) {
+			return p + __builtin_ctz (mask);
+		}
+		p += 16;
+	}
+#endif
+	while (p < end && *p != '"' && *p != '\\' && *p >= 0x20 && *p < 0x80) {
+		p++;
+	}
+	return p;
+}
+
+/* Length of the UTF-8 sequence at p (not ASCII), 0 if invalid: overlong
+ * forms, surrogates and code points above U+10FFFF are rejected */
+static size_t jscan_utf8_len (const unsigned char *p, const unsigned char *end)
+{
+	/* range of the second byte */
+	unsigned char lo = 0x80, hi = 0xbf;
+	size_t n;
+	if (*p >= 0xc2 && *p <= 0xdf) {
+		n = 2;
+	} else if (*p >= 0xe0 && *p <= 0xef) {
+		n = 3;
+		if (*p == 0xe0) {
+			lo = 0xa0;
+		} else if (*p == 0xed) {
+			hi = 0x9f;
+		}
+	} else if (*p >= 0xf0 && *p <= 0xf4) {
+		n = 4;
+		if (*p == 0xf0) {
+			lo = 0x90;
+		} else if (*p == 0xf4) {
+			hi = 0x8f;
+		}
+	} else {
+		return 0;
+	}
+	if ((size_t) (end - p) < n || p[1] < lo || p[1] > hi) {
+		return 0;
+	}
+	for (size_t i = 2; i < n; i++) {
+		if ((p[i] & 0xc0) != 0x80) {
+			return 0;
+		}
+	}
+	return n;
+}
+
+static void jscan_buf_add (jscan_t *s, const unsigned char *str, size_t n)
+{
+	if (!n) {
+		return;
+	}
+	if (s->buf_len + n > s->buf_size) {
+		s->buf_size = (s->buf_len + n) * 2;
+		REALLOC (s->buf, s->buf_size);
+	}
+	memcpy (s->buf + s->buf_len, str, n);
+	s->buf_len += n;
+}
+
+static int jscan_hex4 (const unsigned char *p)
+{
+	int v = 0;
+	for (int i = 0; i < 4; i++) {
+		const unsigned char c = p[i];
+		v <<= 4;
+		if (c >= '0' && c <= '9') {
+			v |= c - '0';
+		} else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+			v |= (c | 0x20) - 'a' + 10;
+		} else {
+			return -1;
+		}
+	}
+	return v;
+}
+
+static void jscan_buf_utf8 (jscan_t *s, uint32_t cp)
+{
+	unsigned char u[4];
+	size_t n;
+	if (cp < 0x80) {
+		u[0] = cp;
+		n = 1;
+	} else if (cp < 0x800) {
+		u[0] = 0xc0 | (cp >> 6);
+		u[1] = 0x80 | (cp & 0x3f);
+		n = 2;
+	} else if (cp < 0x10000) {
+		u[0] = 0xe0 | (cp >> 12);
+		u[1] = 0x80 | ((cp >> 6) & 0x3f);
+		u[2] = 0x80 | (cp & 0x3f);
+		n = 3;
+	} else {
+		u[0] = 0xf0 | (cp >> 18);
+		u[1] = 0x80 | ((cp >> 12) & 0x3f);
+		u[2] = 0x80 | ((cp >> 6) & 0x3f);
+		u[3] = 0x80 | (cp & 0x3f);
+		n = 4;
+	}
+	jscan_buf_add (s, u, n);
+}
+
+/* Escape sequence after the '\\' at s->p */
+static bool jscan_escape (jscan_t *s)
+{
+	static const unsigned char simple[][2] = {
+		{'"', '"'}, {'\\', '\\'}, {'/', '/'}, {'b', '\b'},
+		{'f', '\f'}, {'n', '\n'}, {'r', '\r'}, {'t', '\t'}
+	};
+
+	if (s->end - s->p < 2) {
+		return jscan_error (s, "premature EOF");
+	}
+	const unsigned char c = s->p[1];
+	for (size_t i = 0; i < sizeof (simple) / sizeof (simple[0]); i++) {
+		if (c == simple[i][0]) {
+			jscan_buf_add (s, &(simple[i][1]), 1);
+			s->p += 2;
+			return true;
+		}
+	}
+	if (c != 'u') {
+		return jscan_error (s, "inside a string, '\\' occurs before a character which it may not");
+	}
+
+	if (s->end - s->p < 6) {
+		return jscan_error (s, "premature EOF");
+	}
+	int cp = jscan_hex4 (s->p + 2);
+	if (cp < 0) {
+		return jscan_error (s, "invalid (non-hex) character occurs after '\\u' inside string");
+	}
+	s->p += 6;
+	if (cp >= 0xd800 && cp <= 0xdbff) {
+		/* surrogate pair, a lone one is replaced with '?' like yajl does */
+		const int low = (s->end - s->p >= 6 && s->p[0] == '\\' && s->p[1] == 'u')
+			? jscan_hex4 (s->p + 2) : -1;
+		if (low >= 0xdc00 && low <= 0xdfff) {
+			cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+			s->p += 6;
+		} else {
+			cp = '?';
+		}
+	} else if (cp >= 0xdc00 && cp <= 0xdfff) {
+		cp = '?';
+	}
+	jscan_buf_utf8 (s, cp);
+	return true;
+}
+
+/* String at s->p (on the opening quote), *str is in s or in s->buf */
+static bool jscan_string (jscan_t *s, const unsigned char **str, size_t *len)
+{
+	/* copied to s->buf from the first escape sequence */
+	bool escaped = false;
+	const unsigned char *start = ++s->p;
+	const unsigned char *p = start;
+	while (true) {
+		p = jscan_string_stop (p, s->end);
+		if (p >= s->end) {
+			s->p = p;
+			return jscan_error (s, "premature EOF");
+		}
+		if (*p >= 0x80) {
+			const size_t n = jscan_utf8_len (p, s->end);
+			if (!n) {
+				s->p = p;
+				return jscan_error (s, "invalid bytes in UTF8 string.");
+			}
+			p += n;
+			continue;
+		}
+		if (*p != '"' && *p != '\\') {
+			s->p = p;
+			return jscan_error (s, "invalid character inside string");
+		}
+		if (*p == '"' && !escaped) {
+			*str = start;
+			*len = p - start;
+			s->p = p + 1;
+			return true;
+		}
+		if (!escaped) {
+			s->buf_len = 0;
+			escaped = true;
+		}
+		jscan_buf_add (s, start, p - start);
+		s->p = p;
+		if (*p == '"') {
+			break;
+		}
+		if (!jscan_escape (s)) {
+			return false;
+		}
+		p = start = s->p;
+	}
+	s->p++;
+	*str = s->buf;
+	*len = s->buf_len;
+	return true;
+}
+
+static bool jscan_number (jscan_t *s)
+{
+	static locale_t c_locale = (locale_t) 0;
+	const unsigned char *start = s->p, *p = s->p;
+	bool is_int = true;
+
+	if (p < s->end && *p == '-') {
+		p++;
+	}
+	if (p < s->end && *p == '0') {
+		p++;
+	} else if (p < s->end && *p >= '1' && *p <= '9') {
+		while (p < s->end && *p >= '0' && *p <= '9') {
+			p++;
+		}
+	} else {
+		return jscan_error (s, "malformed number, a digit is required");
+	}
+	if (p < s->end && *p == '.') {
+		is_int = false;
+		if (++p >= s->end || *p < '0' || *p > '9') {
+			return jscan_error (s, "malformed number, a digit is required after the decimal point");
+		}
+		while (p < s->end && *p >= '0' && *p <= '9') {
+			p++;
+		}
+	}
+	if (p < s->end && (*p == 'e' || *p == 'E')) {
+		is_int = false;
+		if (++p < s->end && (*p == '+' || *p == '-')) {
+			p++;
+		}
+		if (p >= s->end || *p < '0' || *p > '9') {
+			return jscan_error (s, "malformed number, a digit is required after the exponent");
+		}
+		while (p < s->end && *p >= '0' && *p <= '9') {
+			p++;
+		}
+	}
+	s->p = p;
+
+	if (s->cb->yajl_number) {
+		return JSCAN_CB (s, yajl_number, (const char *) start, p - start);
+	}
+
+	if (is_int) {
+		const bool neg = (*start == '-');
+		unsigned long long v = 0;
+		for (const unsigned char *d = start + neg; d < p; d++) {
+			const unsigned int digit = *d - '0';
+			if (v > (ULLONG_MAX - digit) / 10) {
+				return jscan_error (s, "integer overflow");
+			}
+			v = v * 10 + digit;
+		}
+		if (v > (unsigned long long) LLONG_MAX + neg) {
+			return jscan_error (s, "integer overflow");
+		}
+		const long long i = (neg) ? (long long) (0 - v) : (long long) v;
+		return JSCAN_CB (s, yajl_integer, i);
+	}
+
+	/* strtod_l() needs a terminated copy, s may go on with more digits */
+	char num[JSCAN_NUM_LEN];
+	const size_t n = p - start;
+	if (n >= sizeof (num)) {
+		return jscan_error (s, "numeric (floating point) overflow");
+	}
+	memcpy (num, start, n);
+	num[n] = '\0';
+	if (c_locale == (locale_t) 0) {
+		c_locale = newlocale (LC_ALL_MASK, "C", (locale_t) 0);
+	}
+	return JSCAN_CB (s, yajl_double, strtod_l (num, NULL, c_locale));
+}
+
+static bool jscan_literal (jscan_t *s, const char *lit, size_t n)
+{
+	if ((size_t) (s->end - s->p) < n || memcmp (s->p, lit, n) != 0) {
+		return jscan_error (s, "invalid literal");
+	}
+	s->p += n;
+	return true;
+}
+
+static bool jscan_value (jscan_t *s);
+
+static bool jscan_map (jscan_t *s)
+{
+	s->p++;
+	if (!JSCAN_CB (s, yajl_start_map)) {
+		return false;
+	}
+	jscan_ws (s);
+	if (s->p < s->end && *s->p == '}') {
+		s->p++;
+		return JSCAN_CB (s, yajl_end_map);
+	}
+	while (true) {
+		const unsigned char *key;
+		size_t len;
+		if (s->p >= s->end || *s->p != '"') {
+			return jscan_error (s, "invalid object key (must be a string)");
+		}
+		if (!jscan_string (s, &key, &len) || !JSCAN_CB (s, yajl_map_key, key, len)) {
+			return false;
+		}
+		jscan_ws (s);
+		if (s->p >= s->end || *s->p != ':') {
+			return jscan_error (s, "object key and value must be separated by a colon (':')");
+		}
+		s->p++;
+		if (!jscan_value (s)) {
+			return false;
+		}
+		jscan_ws (s);
+		if (s->p < s->end && *s->p == ',') {
+			s->p++;
+			jscan_ws (s);
+		} else if (s->p < s->end && *s->p == '}') {
+			s->p++;
+			return JSCAN_CB (s, yajl_end_map);
+		} else {
+			return jscan_error (s, "after key and value, inside map, I expect ',' or '}'");
+		}
+	}
+}
+
+static bool jscan_array (jscan_t *s)
+{
+	s->p++;
+	if (!JSCAN_CB (s, yajl_start_array)) {
+		return false;
+	}
+	jscan_ws (s);
+	if (s->p < s->end && *s->p == ']') {
+		s->p++;
+		return JSCAN_CB (s, yajl_end_array);
+	}
+	while (true) {
+		if (!jscan_value (s)) {
+			return false;
+		}
+		jscan_ws (s);
+		if (s->p < s->end && *s->p == ',') {
+			s->p++;
+		} else if (s->p < s->end && *s->p == ']') {
+			s->p++;
+			return JSCAN_CB (s, yajl_end_array);
+		} else {
+			return jscan_error (s, "after array element, I expect ',' or ']'");
+		}
+	}
+}
+
+static bool jscan_value (jscan_t *s)
+{
+	jscan_ws (s);
+	if (s->p >= s->end) {
+		return jscan_error (s, "premature EOF");
+	}
+
+	bool ret;
+	switch (*s->p) {
+		case '{':
+		case '[':
+			if (++s->depth > JSCAN_MAX_DEPTH) {
+				return jscan_error (s, "max nesting depth exceeded");
+			}
+			ret = (*s->p == '{') ? jscan_map (s) : jscan_array (s);
+			s->depth--;
+			return ret;
+		case '"':
+			{
+				const unsigned char *str;
+				size_t len;
+				return jscan_string (s, &str, &len) && JSCAN_CB (s, yajl_string, str, len);
+			}
+		case 't':
+			return jscan_literal (s, "true", 4) && JSCAN_CB (s, yajl_boolean, 1);
+		case 'f':
+			return jscan_literal (s, "false", 5) && JSCAN_CB (s, yajl_boolean, 0);
+		case 'n':
+			return jscan_literal (s, "null", 4) && JSCAN_CB (s, yajl_null);
+		default:
+			if (*s->p == '-' || (*s->p >= '0' && *s->p <= '9')) {
+				return jscan_number (s);
+			}
+			return jscan_error (s, "invalid char in json text");
+	}
+}
+
+const char *json_scan (const yajl_callbacks *cb, void *ctx,
+		const char *str, size_t len, size_t *offset)
+{
+	jscan_t s = {0};
+	s.cb = cb;
+	s.ctx = ctx;
+	s.p = (const unsigned char *) str;
+	s.end = s.p + len;
+
+	if (jscan_value (&s)) {
+		jscan_ws (&s);
+		if (s.p < s.end) {
+			jscan_error (&s, "trailing garbage");
+		}
+	}
+	FREE (s.buf);
+	if (offset) {
+		*offset = s.p - (const unsigned char *) str;
+	}
+	return s.error;
+}
+
+/* vim: set ts=4 sw=4 noet: */
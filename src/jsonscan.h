@@ -0,0 +1,38 @@
+/*
+ *  jsonscan.h
+ *
+ *  Copyright (c) 2010-2012 Tuxce <tuxce.net@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PQ_JSONSCAN_H
+#define PQ_JSONSCAN_H
+
+#include <stddef.h>
+#include <yajl/yajl_parse.h>
+
+/*
+ * json_scan() parses the len bytes of s in one go, calling cb the way
+ * yajl_parse() followed by yajl_complete_parse() would. Strings without
+ * escapes are passed straight from s. Numbers are parsed in the "C"
+ * locale whatever the current one is.
+ * Returns NULL on success, or an error message and its position in
+ * *offset.
+ */
+const char *json_scan (const yajl_callbacks *cb, void *ctx,
+		const char *s, size_t len, size_t *offset);
+
+#endif
+
+/* vim: set ts=4 sw=4 noet: */
@@ -0,0 +1,536 @@
+/*
+ *  micro-bench.c
+ *
+ *  Copyright (c) 2010-2012 Tuxce <tuxce.net@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Time the formatting, parsing and ranking kernels in isolation:
+ *   micro-bench [-w warmup] [-r samples] [-k kernel] [-n size] response.json...
+ * Responses are RPC info replies (bench/gen-aur-response.py --type info),
+ * their packages feed the kernels working on AUR packages.
+ * The big_* kernels build a worst case input of the given size instead,
+ * bench/check-scaling.py times them at growing sizes. big_*_dp are the
+ * plain dynamic programming distances, the reference for the
+ * bit-parallel ones.
+ * Each sample runs a kernel in a batch long enough to be timed (1 ms at
+ * least), times are reported in ns per call.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <alpm.h>
+#include <alpm_list.h>
+
+#include "util.h"
+#include "aur.h"
+#include "strdist.h"
+
+#define BENCH_MIN_SAMPLE 1e-3
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+
+typedef struct _kernel_t
+{
+	const char *name;
+	/* one call of the kernel, i counts the calls */
+	void (*run) (size_t i);
+	/* the kernel needs packages */
+	bool pkgs;
+} kernel_t;
+
+static const aurpkg_t **pkgs = NULL;
+static size_t pkgs_count = 0;
+static aurresponse_t **responses = NULL;
+static size_t responses_count = 0;
+/* one of the responses, as read */
+static char *payload = NULL;
+static size_t payload_len = 0;
+
+static const char *targets[] = {
+	"lib", "python-git", "core/bash>=5.0", "qt5-base<6", "extra/gtk3=3.24",
+	"linux-headers", "font", "aur/yay-bin>11.0"
+};
+#define TARGETS_COUNT (sizeof (targets) / sizeof (targets[0]))
+
+static const char *words[] = {
+	"glibc", "bash", "zlib>=1.2", "openssl", "python", "gcc-libs",
+	"libx11", "qt5-base", "gtk3", "systemd", "curl", "xz"
+};
+#define WORDS_COUNT (sizeof (words) / sizeof (words[0]))
+
+static alpm_list_t *str_list = NULL;
+static alpm_list_t *dep_list = NULL;
+static strpat_t *pats[TARGETS_COUNT];
+static alpm_list_t *relevance_targets = NULL;
+
+/* inputs of the big_* kernels */
+static size_t big_size = 4096;
+static char *big_pat_str = NULL;
+static strpat_t *big_pat = NULL;
+static char *big_name = NULL;
+static char *big_response = NULL;
+static size_t big_response_len = 0;
+
+static double now (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_target_parse (size_t i)
+{
+	target_free (target_parse (targets[i % TARGETS_COUNT]));
+}
+
+static void bench_format_str (size_t i)
+{
+	char s[] = "%n\\t%v\\n\\\\%d\\033[1m%w\\033[0m";
+	format_str (s);
+}
+
+static void bench_pkg_to_str (size_t i)
+{
+	free (pkg_to_str ("", pkgs[i % pkgs_count], aur_get_str, "%n %v %d %w %p %m %D %M %o"));
+}
+
+/* concat_*() allocate in the record arena, reset like for each package */
+static void bench_concat_str_list (size_t i)
+{
+	record_reset ();
+	concat_str_list (str_list);
+}
+
+static void bench_concat_str_array (size_t i)
+{
+	record_reset ();
+	concat_str_array (words, WORDS_COUNT);
+}
+
+static void bench_concat_dep_list (size_t i)
+{
+	record_reset ();
+	concat_dep_list (dep_list);
+}
+
+static void bench_aur_response_parse (size_t i)
+{
+	aur_response_free (aur_response_parse (payload, payload_len, NULL));
+}
+
+static void bench_levenshtein (size_t i)
+{
+	strpat_levenshtein (pats[i % TARGETS_COUNT], aur_pkg_get_name (pkgs[i % pkgs_count]));
+}
+
+static void bench_lcs (size_t i)
+{
+	strpat_lcs (pats[i % TARGETS_COUNT], aur_pkg_get_name (pkgs[i % pkgs_count]));
+}
+
+/* The results kernels go through every package at each call */
+static void results_fill (void)
+{
+	for (size_t i = 0; i < pkgs_count; i++) {
+		print_or_add_result (pkgs[i], R_AUR_PKG);
+	}
+}
+
+static void bench_results_add (size_t i)
+{
+	config.sort = S_NAME;
+	results_fill ();
+	results_free ();
+}
+
+static void bench_results_sort (char sort)
+{
+	config.sort = sort;
+	results_fill ();
+	if (sort == S_REL) {
+		calculate_results_relevance (relevance_targets);
+	}
+	results_sort ();
+	results_free ();
+}
+
+static void bench_sort_name (size_t i)
+{
+	bench_results_sort (S_NAME);
+}
+
+static void bench_sort_vote (size_t i)
+{
+	bench_results_sort (S_VOTE);
+}
+
+static void bench_sort_pop (size_t i)
+{
+	bench_results_sort (S_POP);
+}
+
+static void bench_sort_rel (size_t i)
+{
+	bench_results_sort (S_REL);
+}
+
+/* A name and a pattern of big_size characters, of the same letters */
+static void big_names_init (void)
+{
+	MALLOC (big_pat_str, big_size + 1);
+	for (size_t i = 0; i < big_size; i++) {
+		big_pat_str[i] = 'a' + (i * 7) % 26;
+	}
+	big_pat_str[big_size] = '\0';
+	big_pat = strpat_new (big_pat_str);
+	MALLOC (big_name, big_size + 1);
+	for (size_t i = 0; i < big_size; i++) {
+		big_name[i] = 'a' + (i * 11) % 26;
+	}
+	big_name[big_size] = '\0';
+}
+
+/* big_size packages, in reverse name order */
+static void big_response_init (void)
+{
+	string_t *s = string_new ();
+	char head[128];
+	snprintf (head, sizeof (head),
+			"{\"version\":5,\"type\":\"multiinfo\",\"resultcount\":%zu,\"results\":[", big_size);
+	string_cat (s, head);
+	for (size_t i = big_size; i > 0; i--) {
+		char pkg[512];
+		snprintf (pkg, sizeof (pkg), "%s{\"ID\":%zu,\"Name\":\"pkg%08zu\","
+				"\"PackageBase\":\"pkg%08zu\",\"Version\":\"1.%zu-1\","
+				"\"Description\":\"package number %zu\",\"NumVotes\":%zu,"
+				"\"Popularity\":%zu.5,\"Depends\":[\"glibc\",\"pkg%08zu\"]}",
+				(i < big_size) ? "," : "", i, i, i, i, i, i, i % 100, i / 2);
+		string_cat (s, pkg);
+	}
+	string_cat (s, "]}");
+	big_response_len = strlen (string_cstr (s));
+	big_response = string_free2 (s);
+}
+
+static void bench_big_lcs (size_t i)
+{
+	strpat_lcs (big_pat, big_name);
+}
+
+static void bench_big_levenshtein (size_t i)
+{
+	strpat_levenshtein (big_pat, big_name);
+}
+
+/* Row by row dynamic programming, O(n * m) */
+static size_t dp_levenshtein (const char *p, const char *s)
+{
+	const size_t m = strlen (p);
+	size_t *row;
+	MALLOC (row, (m + 1) * sizeof (size_t));
+	for (size_t j = 0; j <= m; j++) {
+		row[j] = j;
+	}
+	for (size_t i = 1; *s; s++, i++) {
+		size_t diag = row[0];
+		row[0] = i;
+		for (size_t j = 1; j <= m; j++) {
+			const size_t up = row[j];
+			const size_t subst = diag + (p[j - 1] != *s);
+			row[j] = MIN (MIN (up, row[j - 1]) + 1, subst);
+			diag = up;
+		}
+	}
+	const size_t ret = row[m];
+	FREE (row);
+	return ret;
+}
+
+static size_t dp_lcs (const char *p, const char *s)
+{
+	const size_t m = strlen (p);
+	size_t *row;
+	CALLOC (row, m + 1, sizeof (size_t));
+	for (; *s; s++) {
+		size_t diag = 0;
+		for (size_t j = 1; j <= m; j++) {
+			const size_t up = row[j];
+			row[j] = (p[j - 1] == *s) ? diag + 1 : MAX (up, row[j - 1]);
+			diag = up;
+		}
+	}
+	const size_t ret = row[m];
+	FREE (row);
+	return ret;
+}
+
+static void bench_big_lcs_dp (size_t i)
+{
+	dp_lcs (big_pat_str, big_name);
+}
+
+static void bench_big_levenshtein_dp (size_t i)
+{
+	dp_levenshtein (big_pat_str, big_name);
+}
+
+/* A long output written a few bytes at a time */
+static void bench_big_string_ncat (size_t i)
+{
+	string_t *s = string_new ();
+	for (size_t k = 0; k < big_size; k++) {
+		string_ncat (s, "%n %v\n", 6);
+	}
+	string_free (s);
+}
+
+static void bench_big_response_parse (size_t i)
+{
+	aur_response_free (aur_response_parse (big_response, big_response_len, NULL));
+}
+
+/* Every target found, in the reverse order of the targets */
+static void bench_big_target_arg_clear (size_t i)
+{
+	alpm_list_t *list = NULL, *args = NULL;
+	for (size_t k = 0; k < big_size; k++) {
+		char s[32];
+		snprintf (s, sizeof (s), "target%zu", k);
+		list = alpm_list_add (list, strdup (s));
+	}
+	for (const alpm_list_t *k = alpm_list_last (list); k; k = (k == list) ? NULL : k->prev) {
+		args = alpm_list_add (args, k->data);
+	}
+	target_arg_t *ta = target_arg_init (NULL, NULL, NULL);
+	ta->args = args;
+	list = target_arg_close (ta, list);
+	FREELIST (list);
+}
+
+static const kernel_t kernels[] = {
+	{"target_parse", bench_target_parse, false},
+	{"format_str", bench_format_str, false},
+	{"concat_str_list", bench_concat_str_list, false},
+	{"concat_str_array", bench_concat_str_array, false},
+	{"concat_dep_list", bench_concat_dep_list, false},
+	{"pkg_to_str", bench_pkg_to_str, true},
+	{"aur_response_parse", bench_aur_response_parse, true},
+	{"levenshtein", bench_levenshtein, true},
+	{"lcs", bench_lcs, true},
+	{"results_add", bench_results_add, true},
+	{"sort_name", bench_sort_name, true},
+	{"sort_vote", bench_sort_vote, true},
+	{"sort_pop", bench_sort_pop, true},
+	{"sort_rel", bench_sort_rel, true},
+	{"big_lcs", bench_big_lcs, false},
+	{"big_levenshtein", bench_big_levenshtein, false},
+	{"big_lcs_dp", bench_big_lcs_dp, false},
+	{"big_levenshtein_dp", bench_big_levenshtein_dp, false},
+	{"big_string_ncat", bench_big_string_ncat, false},
+	{"big_response_parse", bench_big_response_parse, false},
+	{"big_target_arg_clear", bench_big_target_arg_clear, false},
+};
+
+static int double_cmp (const void *d1, const void *d2)
+{
+	const double v1 = *(const double *) d1;
+	const double v2 = *(const double *) d2;
+	return (v1 > v2) - (v1 < v2);
+}
+
+static double percentile (const double *v, size_t n, unsigned int p)
+{
+	size_t rank = (p * n + 99) / 100;
+	return v[(rank) ? rank - 1 : 0];
+}
+
+static void run_kernel (const kernel_t *k, int warmup, int samples)
+{
+	/* calls per sample */
+	size_t batch = 1, calls = 0;
+	while (true) {
+		const double start = now ();
+		for (size_t i = 0; i < batch; i++) {
+			k->run (calls++);
+		}
+		if (now () - start >= BENCH_MIN_SAMPLE || batch >= ((size_t) 1 << 30)) {
+			break;
+		}
+		batch *= 2;
+	}
+
+	double ns[samples];
+	for (int s = -warmup; s < samples; s++) {
+		const double start = now ();
+		for (size_t i = 0; i < batch; i++) {
+			k->run (calls++);
+		}
+		if (s >= 0) {
+			ns[s] = (now () - start) * 1e9 / batch;
+		}
+	}
+	qsort (ns, samples, sizeof (double), double_cmp);
+	printf ("%-20s %10zu %12.1f %12.1f %12.1f %12.1f %12.1f\n", k->name, batch,
+			ns[0], percentile (ns, samples, 50), percentile (ns, samples, 90),
+			percentile (ns, samples, 99), ns[samples - 1]);
+}
+
+static char *read_file (const char *path, size_t *len)
+{
+	FILE *f = fopen (path, "rb");
+	if (!f) {
+		perror (path);
+		return NULL;
+	}
+	size_t size = 65536, n = 0, r;
+	char *buf = malloc (size + 1);
+	while (buf && (r = fread (buf + n, 1, size - n, f)) > 0) {
+		n += r;
+		if (n == size) {
+			size *= 2;
+			buf = realloc (buf, size + 1);
+		}
+	}
+	fclose (f);
+	if (buf) {
+		buf[n] = '\0';
+		*len = n;
+	}
+	return buf;
+}
+
+static bool load_response (const char *path)
+{
+	size_t len;
+	char *s = read_file (path, &len);
+	if (!s) {
+		return false;
+	}
+	aurresponse_t *res = aur_response_parse (s, len, NULL);
+	if (!res) {
+		fprintf (stderr, "%s: not a RPC response\n", path);
+		free (s);
+		return false;
+	}
+	REALLOC (responses, (responses_count + 1) * sizeof (aurresponse_t *));
+	responses[responses_count++] = res;
+	REALLOC (pkgs, (pkgs_count + aur_response_count (res)) * sizeof (aurpkg_t *));
+	for (size_t i = 0; i < aur_response_count (res); i++) {
+		pkgs[pkgs_count++] = aur_response_pkg (res, i);
+	}
+	/* the biggest one is kept for aur_response_parse */
+	if (len > payload_len) {
+		free (payload);
+		payload = s;
+		payload_len = len;
+	} else {
+		free (s);
+	}
+	return true;
+}
+
+int main (int argc, char **argv)
+{
+	int warmup = 3, samples = 30, opt, ret = 0;
+	const char *only = NULL;
+
+	while ((opt = getopt (argc, argv, "w:r:k:n:")) != -1) {
+		switch (opt) {
+			case 'w':
+				warmup = atoi (optarg);
+				break;
+			case 'r':
+				samples = atoi (optarg);
+				break;
+			case 'k':
+				only = optarg;
+				break;
+			case 'n':
+				big_size = strtoul (optarg, NULL, 10);
+				break;
+			default:
+				fprintf (stderr, "usage: %s [-w warmup] [-r samples] [-k kernel] [-n size] response.json...\n", argv[0]);
+				return 1;
+		}
+	}
+	if (warmup < 0 || samples < 1) {
+		fprintf (stderr, "%s: bad number of samples\n", argv[0]);
+		return 1;
+	}
+	if (big_size < 1) {
+		fprintf (stderr, "%s: bad size\n", argv[0]);
+		return 1;
+	}
+
+	memset (&config, 0, sizeof (aq_config));
+	strcpy (config.delimiter, " ");
+	for (int i = optind; i < argc; i++) {
+		if (!load_response (argv[i])) {
+			ret = 1;
+		}
+	}
+	for (size_t i = 0; i < WORDS_COUNT; i++) {
+		str_list = alpm_list_add (str_list, (void *) words[i]);
+		dep_list = alpm_list_add (dep_list, alpm_dep_from_string (words[i]));
+	}
+	for (size_t i = 0; i < TARGETS_COUNT; i++) {
+		pats[i] = strpat_new (targets[i]);
+	}
+	relevance_targets = alpm_list_add (relevance_targets, (void *) "lib");
+	config.just_one = true;
+	big_names_init ();
+	big_response_init ();
+
+	printf ("%-20s %10s %12s %12s %12s %12s %12s\n", "kernel (ns/call)", "batch",
+			"min", "p50", "p90", "p99", "max");
+	for (size_t i = 0; i < sizeof (kernels) / sizeof (kernels[0]); i++) {
+		const kernel_t *k = &(kernels[i]);
+		if (only && !strstr (k->name, only)) {
+			continue;
+		}
+		if (k->pkgs && !pkgs_count) {
+			printf ("%-20s %10s\n", k->name, "(no packages)");
+			continue;
+		}
+		run_kernel (k, warmup, samples);
+	}
+
+	for (size_t i = 0; i < TARGETS_COUNT; i++) {
+		strpat_free (pats[i]);
+	}
+	alpm_list_free_inner (dep_list, (alpm_list_fn_free) alpm_dep_free);
+	alpm_list_free (dep_list);
+	alpm_list_free (str_list);
+	alpm_list_free (relevance_targets);
+	strpat_free (big_pat);
+	free (big_pat_str);
+	free (big_name);
+	free (big_response);
+	for (size_t i = 0; i < responses_count; i++) {
+		aur_response_free (responses[i]);
+	}
+	free (responses);
+	free (pkgs);
+	free (payload);
+	record_cleanup ();
+	return ret;
+}
+
+/* vim: set ts=4 sw=4 noet: */
@@ -0,0 +1,322 @@
+/*
+ *  netstats.c
+ *
+ *  Copyright (c) 2010-2012 Tuxce <tuxce.net@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <yajl/yajl_gen.h>
+
+#include "util.h"
+#include "netstats.h"
+
+/*
+ * Requests are grouped by host and first path segment, e.g.
+ * aur.archlinux.org/rpc.php, aur.archlinux.org/cgit or
+ * www.archlinux.org/packages.
+ */
+
+/* Latency histogram upper bounds (ms), one more bucket for the rest */
+static const double netstats_buckets[] = {
+	1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000
+};
+#define NETSTATS_BUCKETS (sizeof (netstats_buckets) / sizeof (netstats_buckets[0]))
+
+typedef enum
+{
+	NT_DNS = 0,
+	NT_CONNECT,
+	NT_TLS,
+	NT_TTFB,
+	NT_TOTAL,
+	NT_LAST
+} nettime_t;
+
+static const char *nettime_names[] =
+{
+	"dns_ms",
+	"connect_ms",
+	"tls_ms",
+	"ttfb_ms",
+	"total_ms"
+};
+
+typedef struct _netreq_t
+{
+	char *url;
+	char *group;
+	const char *error;
+	const char *http_version;
+	long http_code;
+	bool reused;
+	long long bytes_down;
+	long long bytes_up;
+	double times[NT_LAST];
+} netreq_t;
+
+static char *netstats_path = NULL;
+static netreq_t *reqs = NULL;
+static size_t reqs_count = 0;
+static size_t reqs_size = 0;
+
+void netstats_init (const char *path)
+{
+	FREE (netstats_path);
+	netstats_path = strdup (path);
+}
+
+static char *netstats_group (const char *url)
+{
+	const char *host = strstr (url, "://");
+	host = (host) ? host + 3 : url;
+	const char *path = host + strcspn (host, "/?#");
+	size_t len = path - host;
+	if (*path == '/') {
+		len += 1 + strcspn (path + 1, "/?#");
+	}
+	return strndup (host, len);
+}
+
+static const char *netstats_http_version (CURL *curl)
+{
+#if LIBCURL_VERSION_NUM >= 0x073200
+	long v = 0;
+	curl_easy_getinfo (curl, CURLINFO_HTTP_VERSION, &v);
+	switch (v) {
+		case CURL_HTTP_VERSION_1_0:
+			return "1.0";
+		case CURL_HTTP_VERSION_1_1:
+			return "1.1";
+		case CURL_HTTP_VERSION_2_0:
+			return "2";
+#if LIBCURL_VERSION_NUM >= 0x074200
+		case CURL_HTTP_VERSION_3:
+			return "3";
+#endif
+	}
+#endif
+	return NULL;
+}
+
+void netstats_add (CURL *curl, const char *url, CURLcode code)
+{
+	if (!netstats_path) {
+		return;
+	}
+
+	if (reqs_count == reqs_size) {
+		reqs_size = (reqs_size) ? reqs_size * 2 : 16;
+		REALLOC (reqs, reqs_size * sizeof (netreq_t));
+	}
+	netreq_t *r = &(reqs[reqs_count++]);
+	memset (r, 0, sizeof (netreq_t));
+	r->url = strdup (url);
+	r->group = netstats_group (url);
+	r->error = (code != CURLE_OK) ? curl_easy_strerror (code) : NULL;
+	r->http_version = netstats_http_version (curl);
+
+	/* curl times are from the start of the transfer, split them by step */
+	double namelookup = 0, connect = 0, appconnect = 0, starttransfer = 0, total = 0;
+	long connects = 0;
+	curl_easy_getinfo (curl, CURLINFO_RESPONSE_CODE, &(r->http_code));
+	curl_easy_getinfo (curl, CURLINFO_NUM_CONNECTS, &connects);
+#if LIBCURL_VERSION_NUM >= 0x073700
+	curl_off_t down = 0, up = 0;
+	curl_easy_getinfo (curl, CURLINFO_SIZE_DOWNLOAD_T, &down);
+	curl_easy_getinfo (curl, CURLINFO_SIZE_UPLOAD_T, &up);
+#else
+	double down = 0, up = 0;
+	curl_easy_getinfo (curl, CURLINFO_SIZE_DOWNLOAD, &down);
+	curl_easy_getinfo (curl, CURLINFO_SIZE_UPLOAD, &up);
+#endif
+	r->bytes_down = down;
+	r->bytes_up = up;
+	curl_easy_getinfo (curl, CURLINFO_NAMELOOKUP_TIME, &namelookup);
+	curl_easy_getinfo (curl, CURLINFO_CONNECT_TIME, &connect);
+	curl_easy_getinfo (curl, CURLINFO_APPCONNECT_TIME, &appconnect);
+	curl_easy_getinfo (curl, CURLINFO_STARTTRANSFER_TIME, &starttransfer);
+	curl_easy_getinfo (curl, CURLINFO_TOTAL_TIME, &total);
+	r->reused = (code == CURLE_OK && connects == 0);
+	r->times[NT_DNS] = namelookup * 1e3;
+	r->times[NT_CONNECT] = (connect > namelookup) ? (connect - namelookup) * 1e3 : 0;
+	r->times[NT_TLS] = (appconnect > connect) ? (appconnect - connect) * 1e3 : 0;
+	r->times[NT_TTFB] = starttransfer * 1e3;
+	r->times[NT_TOTAL] = total * 1e3;
+}
+
+static int double_cmp (const void *d1, const void *d2)
+{
+	const double v1 = *(const double *) d1;
+	const double v2 = *(const double *) d2;
+	return (v1 > v2) - (v1 < v2);
+}
+
+/* Nearest-rank percentile of n sorted values */
+static double percentile (const double *v, size_t n, unsigned int p)
+{
+	size_t rank = (p * n + 99) / 100;
+	return v[(rank) ? rank - 1 : 0];
+}
+
+static void netstats_gen_times (yajl_gen g, const char *key, const size_t *idx, size_t n, nettime_t t)
+{
+	double v[n];
+	double sum = 0;
+	for (size_t i = 0; i < n; i++) {
+		v[i] = reqs[idx[i]].times[t];
+		sum += v[i];
+	}
+	qsort (v, n, sizeof (double), double_cmp);
+
+	json_gen_key (g, key);
+	yajl_gen_map_open (g);
+	json_gen_double (g, "min", v[0]);
+	json_gen_double (g, "mean", sum / n);
+	json_gen_double (g, "p50", percentile (v, n, 50));
+	json_gen_double (g, "p90", percentile (v, n, 90));
+	json_gen_double (g, "p99", percentile (v, n, 99));
+	json_gen_double (g, "max", v[n - 1]);
+	yajl_gen_map_close (g);
+}
+
+static void netstats_gen_group (yajl_gen g, const char *group, const size_t *idx, size_t n)
+{
+	unsigned long errors = 0, reused = 0;
+	long long bytes = 0;
+	unsigned long hist[NETSTATS_BUCKETS + 1] = {0};
+	for (size_t i = 0; i < n; i++) {
+		const netreq_t *r = &(reqs[idx[i]]);
+		errors += (r->error || r->http_code != 200);
+		reused += r->reused;
+		bytes += r->bytes_down;
+		size_t b = 0;
+		while (b < NETSTATS_BUCKETS && r->times[NT_TOTAL] > netstats_buckets[b]) {
+			b++;
+		}
+		hist[b]++;
+	}
+
+	yajl_gen_map_open (g);
+	json_gen_str (g, "group", group);
+	json_gen_int (g, "requests", n);
+	json_gen_int (g, "errors", errors);
+	json_gen_int (g, "reused", reused);
+	json_gen_int (g, "bytes_down", bytes);
+	for (nettime_t t = 0; t < NT_LAST; t++) {
+		netstats_gen_times (g, nettime_names[t], idx, n, t);
+	}
+	/* counts[i] is the number of total_ms <= le_ms[i],
+	 * the last count is for the slower ones */
+	json_gen_key (g, "histogram");
+	yajl_gen_map_open (g);
+	json_gen_key (g, "le_ms");
+	yajl_gen_array_open (g);
+	for (size_t b = 0; b < NETSTATS_BUCKETS; b++) {
+		yajl_gen_integer (g, (long long) netstats_buckets[b]);
+	}
+	yajl_gen_array_close (g);
+	json_gen_key (g, "counts");
+	yajl_gen_array_open (g);
+	for (size_t b = 0; b <= NETSTATS_BUCKETS; b++) {
+		yajl_gen_integer (g, hist[b]);
+	}
+	yajl_gen_array_close (g);
+	yajl_gen_map_close (g);
+	yajl_gen_map_close (g);
+}
+
+static void netstats_gen_request (yajl_gen g, const netreq_t *r)
+{
+	yajl_gen_map_open (g);
+	json_gen_str (g, "url", r->url);
+	json_gen_str (g, "group", r->group);
+	json_gen_int (g, "http_code", r->http_code);
+	json_gen_str (g, "http_version", r->http_version);
+	json_gen_bool (g, "reused", r->reused);
+	json_gen_str (g, "error", r->error);
+	json_gen_int (g, "bytes_down", r->bytes_down);
+	json_gen_int (g, "bytes_up", r->bytes_up);
+	for (nettime_t t = 0; t < NT_LAST; t++) {
+		json_gen_double (g, nettime_names[t], r->times[t]);
+	}
+	yajl_gen_map_close (g);
+}
+
+static void netstats_print_cb (void *ctx, const char *str, size_t len)
+{
+	fwrite (str, 1, len, (FILE *) ctx);
+}
+
+void netstats_report (void)
+{
+	if (!netstats_path) {
+		return;
+	}
+
+	FILE *out = (strcmp (netstats_path, "-") == 0) ? stderr : fopen (netstats_path, "w");
+	if (!out) {
+		perror (netstats_path);
+	} else {
+		yajl_gen g = yajl_gen_alloc (NULL);
+		yajl_gen_config (g, yajl_gen_print_callback, netstats_print_cb, out);
+		yajl_gen_map_open (g);
+		json_gen_key (g, "requests");
+		yajl_gen_array_open (g);
+		for (size_t i = 0; i < reqs_count; i++) {
+			netstats_gen_request (g, &(reqs[i]));
+		}
+		yajl_gen_array_close (g);
+
+		json_gen_key (g, "groups");
+		yajl_gen_array_open (g);
+		size_t idx[reqs_count ? reqs_count : 1];
+		bool done[reqs_count ? reqs_count : 1];
+		memset (done, 0, sizeof (done));
+		for (size_t i = 0; i < reqs_count; i++) {
+			if (done[i]) {
+				continue;
+			}
+			size_t n = 0;
+			for (size_t j = i; j < reqs_count; j++) {
+				if (!done[j] && strcmp (reqs[i].group, reqs[j].group) == 0) {
+					idx[n++] = j;
+					done[j] = true;
+				}
+			}
+			netstats_gen_group (g, reqs[i].group, idx, n);
+		}
+		yajl_gen_array_close (g);
+		yajl_gen_map_close (g);
+		yajl_gen_free (g);
+		fputc ('\n', out);
+		if (out != stderr) {
+			fclose (out);
+		}
+	}
+
+	for (size_t i = 0; i < reqs_count; i++) {
+		free (reqs[i].url);
+		free (reqs[i].group);
+	}
+	FREE (reqs);
+	reqs_count = reqs_size = 0;
+	FREE (netstats_path);
+}
+
+/* vim: set ts=4 sw=4 noet: */
@@ -0,0 +1,36 @@
+/*
+ *  netstats.h
+ *
+ *  Copyright (c) 2010-2012 Tuxce <tuxce.net@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PQ_NETSTATS_H
+#define PQ_NETSTATS_H
+
+#include <curl/curl.h>
+
+/* netstats_init() records requests from now on, the summary goes to
+ * path ("-" for stderr) */
+void netstats_init (const char *path);
+
+/* netstats_add() records the transfer curl just did */
+void netstats_add (CURL *curl, const char *url, CURLcode code);
+
+/* netstats_report() writes the JSON summary */
+void netstats_report (void);
+
+#endif
+
+/* vim: set ts=4 sw=4 noet: */
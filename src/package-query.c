@@ -23,6 +23,7 @@
 #define PACKAGE_VERSION GIT_VERSION
 #endif
 
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
@@ -34,6 +35,9 @@
 #include "color.h"
 #include "alpm-query.h"
 #include "aur.h"
+#include "stats.h"
+#include "netstats.h"
+#include "replay.h"
 
 #define N_DB     1
 #define N_TARGET 2
@@ -53,17 +57,26 @@ static void cleanup (int ret)
 	if (config.handle && alpm_release (config.handle) == -1) {
 		fprintf(stderr, "error releasing alpm library\n");
 	}
+	json_close ();
+	/* results not shown on an early exit, with their response arenas */
+	results_free ();
 	FREELIST (targets);
 	FREE (config.arch);
 	FREE (config.aur_url);
+	FREE (config.arch_url);
 	FREE (config.configfile);
 	FREE (config.format_out);
 	FREE (config.dbpath);
 	FREE (config.rootdir);
-	alpm_cleanup ();
-	aur_cleanup ();
+	record_cleanup ();
 	color_cleanup ();
 	curl_cleanup ();
+	stats_report ();
+	netstats_report ();
+	replay_cleanup ();
+#ifdef ENABLE_ALLOC_STATS
+	alloc_report ();
+#endif
 	exit (ret);
 }
 
@@ -74,6 +87,7 @@ static void init_config (const char *myname)
 	config.colors = isatty(1) ? true : false;
 	config.query = OP_Q_ALL;
 	config.aur_url = strdup (AUR_BASE_URL);
+	config.arch_url = strdup (ARCH_PACKAGES_URL);
 	config.configfile = strndup (CONFFILE, PATH_MAX);
 	strcpy (config.delimiter, " ");
 }
@@ -97,13 +111,22 @@ static void usage (unsigned short _error)
 	fprintf(stderr, "\n\t--delimiter          define list separator");
 	fprintf(stderr, "\n\t-f --format <format>");
 	fprintf(stderr, "\n\t-h --help            show this help");
+	fprintf(stderr, "\n\t--json               output a JSON array of packages");
+	fprintf(stderr, "\n\t--ndjson             output one JSON object per line");
 	fprintf(stderr, "\n\t-q --quiet           quiet");
 	fprintf(stderr, "\n\t-x --escape          escape \" on output");
 	fprintf(stderr, "\n\t--nocolor            output without colors");
 	fprintf(stderr, "\n\t--sort <parameter>   sort search results by a parameter");
 	fprintf(stderr, "\n\t--rsort <parameter>  sort search results in reverse order");
+	fprintf(stderr, "\n\t--limit <n>          show the first n search results only");
 	fprintf(stderr, "\n\t--show-size          show package size");
 	fprintf(stderr, "\n\t--insecure           perform insecure ssl connection (curl)");
+	fprintf(stderr, "\n\t--stats              print time spent in each phase to stderr");
+	fprintf(stderr, "\n\t--hwstats            same as --stats, with CPU counters (cache misses...)");
+	fprintf(stderr, "\n\t--netstats <file>    write network request metrics to file (JSON)");
+	fprintf(stderr, "\n\t--trace <file>       write a timeline of the run to file (Chrome trace)");
+	fprintf(stderr, "\n\t--record <dir>       save HTTP requests and responses in dir");
+	fprintf(stderr, "\n\t--replay <dir>       answer HTTP requests from a recorded dir");
 	fprintf(stderr, "\n");
 	fprintf(stderr, "\n\t-A --aur             query AUR database");
 	fprintf(stderr, "\n\t-Q --query           search in local database");
@@ -157,22 +180,31 @@ static void usage (unsigned short _error)
 
 static unsigned int deal_db (alpm_db_t *db)
 {
+	unsigned int ret = 0;
+	stats_begin (ST_DB, alpm_db_get_name (db));
 	switch (config.op) {
 		case OP_LIST_REPO:
 		case OP_LIST_REPO_S:
-			return list_db (db, targets);
+			ret = list_db (db, targets);
+			break;
 		case OP_INFO:
 		case OP_INFO_P:
-			return search_pkg_by_name (db, &targets);
+			ret = search_pkg_by_name (db, &targets);
+			break;
 		case OP_SEARCH:
-			return search_pkg (db, targets);
+			ret = search_pkg (db, targets);
+			break;
 		case OP_LIST_GROUP:
-			return list_grp (db, targets);
+			ret = list_grp (db, targets);
+			break;
 		case OP_QUERY:
-			return search_pkg_by_type (db, &targets);
+			ret = search_pkg_by_type (db, &targets);
+			break;
 		default:
-			return 0;
+			break;
 	}
+	stats_end ();
+	return ret;
 }
 
 static unsigned int deal_sync_dbs (void)
@@ -244,6 +276,16 @@ int main (int argc, char **argv)
 		{"pkgbase",    no_argument,       0, 1016},
 		{"nameonly",   no_argument,       0, 1017},
 		{"maintainer", no_argument,       0, 1018},
+		{"json",       no_argument,       0, 1019},
+		{"ndjson",     no_argument,       0, 1020},
+		{"limit",      required_argument, 0, 1021},
+		{"stats",      no_argument,       0, 1022},
+		{"netstats",   required_argument, 0, 1023},
+		{"trace",      required_argument, 0, 1024},
+		{"hwstats",    no_argument,       0, 1025},
+		{"arch-url",   required_argument, 0, 1026},
+		{"record",     required_argument, 0, 1027},
+		{"replay",     required_argument, 0, 1028},
 		{"version",    no_argument,       0, 'v'},
 
 		{0, 0, 0, 0}
@@ -422,6 +464,47 @@ int main (int argc, char **argv)
 			case 1018: /* --maintainer */
 				config.aur_maintainer = true;
 				break;
+			case 1020: /* --ndjson */
+				config.json_lines = true;
+				/* fallthrough */
+			case 1019: /* --json */
+				config.json = true;
+				break;
+			case 1021: /* --limit */
+			{
+				/* strtoul() would take "-1" as ULONG_MAX */
+				char *end = NULL;
+				errno = 0;
+				const unsigned long limit = strtoul (optarg, &end, 10);
+				if (optarg[0] < '0' || optarg[0] > '9' || *end || errno || limit > UINT_MAX) {
+					fprintf (stderr, "invalid --limit: %s\n", optarg);
+					usage (1);
+				}
+				config.limit = limit;
+				break;
+			}
+			case 1022: /* --stats */
+				stats_init ();
+				break;
+			case 1023: /* --netstats */
+				netstats_init (optarg);
+				break;
+			case 1024: /* --trace */
+				stats_trace (optarg);
+				break;
+			case 1025: /* --hwstats */
+				stats_hw_init ();
+				break;
+			case 1026: /* --arch-url */
+				free (config.arch_url);
+				config.arch_url = strdup (optarg);
+				break;
+			case 1027: /* --record */
+				replay_record (optarg);
+				break;
+			case 1028: /* --replay */
+				replay_serve (optarg);
+				break;
 			default: /* '?' */
 				usage (1);
 				break;
@@ -440,7 +523,9 @@ int main (int argc, char **argv)
 		cleanup (0);
 	}
 
-	if (!config.custom_out) {
+	if (config.json) {
+		json_open ();
+	} else if (!config.custom_out) {
 		if (config.colors) {
 			color_init ();
 		}
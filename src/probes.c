@@ -0,0 +1,30 @@
+/*
+ *  probes.c
+ *
+ *  Copyright (c) 2010-2012 Tuxce <tuxce.net@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+
+#include "probes.h"
+
+#ifdef HAVE_SYS_SDT_H
+/* Set by the tracer (bpftrace, stap...) while it is attached */
+#define PROBE_DEFINE(name) \
+	unsigned short PROBE_SEMAPHORE (name) __attribute__ ((section (".probes")));
+PROBES(PROBE_DEFINE)
+#endif
+
+/* vim: set ts=4 sw=4 noet: */
@@ -0,0 +1,85 @@
+/*
+ *  probes.h
+ *
+ *  Copyright (c) 2010-2012 Tuxce <tuxce.net@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PQ_PROBES_H
+#define PQ_PROBES_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * USDT probes, built in when sys/sdt.h is found. Each one fires when
+ * its function is done, the last argument being the time spent in it
+ * (ns):
+ *   print_package (name, ns)
+ *   filter (name, filter, matched, ns)
+ *   curl_fetch (url, curl code, ns)
+ *   aur_json_parse (bytes, packages, ns)
+ *   target_parse (name, ns)
+ *   show_results (results, ns)
+ * e.g. bpftrace -e 'usdt:/usr/bin/package-query:package_query:print_package
+ *     { printf ("%s %d\n", str (arg0), arg1); }'
+ * Nothing is computed for a probe unless a tracer set its semaphore.
+ */
+#define PROBES(X) \
+	X(print_package) \
+	X(filter) \
+	X(curl_fetch) \
+	X(aur_json_parse) \
+	X(target_parse) \
+	X(show_results)
+
+static inline uint64_t probe_clock (void)
+{
+	struct timespec ts;
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+#ifdef HAVE_SYS_SDT_H
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define PROBE_SEMAPHORE(name) package_query_##name##_semaphore
+#define PROBE_DECLARE(name) extern unsigned short PROBE_SEMAPHORE (name);
+PROBES(PROBE_DECLARE)
+
+#define PROBE_ENABLED(name) __builtin_expect (PROBE_SEMAPHORE (name), 0)
+#define PROBE_START(name) (PROBE_ENABLED (name) ? probe_clock () : 0)
+#define PROBE_DONE1(name, start, a1) do { \
+    if (PROBE_ENABLED (name)) \
+      STAP_PROBE2 (package_query, name, a1, probe_clock () - (start)); \
+  } while (0)
+#define PROBE_DONE2(name, start, a1, a2) do { \
+    if (PROBE_ENABLED (name)) \
+      STAP_PROBE3 (package_query, name, a1, a2, probe_clock () - (start)); \
+  } while (0)
+#define PROBE_DONE3(name, start, a1, a2, a3) do { \
+    if (PROBE_ENABLED (name)) \
+      STAP_PROBE4 (package_query, name, a1, a2, a3, probe_clock () - (start)); \
+  } while (0)
+#else
+#define PROBE_START(name) 0
+#define PROBE_DONE1(name, start, a1) do { (void) (start); } while (0)
+#define PROBE_DONE2(name, start, a1, a2) do { (void) (start); } while (0)
+#define PROBE_DONE3(name, start, a1, a2, a3) do { (void) (start); } while (0)
+#endif
+
+#endif
+
+/* vim: set ts=4 sw=4 noet: */
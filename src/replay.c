@@ -0,0 +1,206 @@
+/*
+ *  replay.c
+ *
+ *  Copyright (c) 2010-2012 Tuxce <tuxce.net@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "util.h"
+#include "replay.h"
+
+/*
+ * Each exchange is saved in two files named after a hash of its URL:
+ *   HASH.meta   "key value" lines: url, curl_code, http_code, total_us
+ *   HASH.body   the response body, as given by curl (decompressed)
+ * The time is an integer, the output of %f would depend on the locale.
+ * A URL requested again overwrites the previous exchange.
+ */
+
+typedef enum
+{
+	REPLAY_OFF = 0,
+	REPLAY_RECORD,
+	REPLAY_SERVE
+} replaymode_t;
+
+static replaymode_t replay_mode = REPLAY_OFF;
+static char *replay_dir = NULL;
+
+static void replay_set (const char *dir, replaymode_t mode)
+{
+	FREE (replay_dir);
+	replay_dir = strdup (dir);
+	replay_mode = mode;
+}
+
+void replay_record (const char *dir)
+{
+	if (mkdir (dir, 0755) != 0 && errno != EEXIST) {
+		perror (dir);
+		return;
+	}
+	replay_set (dir, REPLAY_RECORD);
+}
+
+void replay_serve (const char *dir)
+{
+	replay_set (dir, REPLAY_SERVE);
+}
+
+bool replay_serving (void)
+{
+	return (replay_mode == REPLAY_SERVE);
+}
+
+static char *replay_path (const char *url, const char *ext)
+{
+	/* FNV-1a */
+	uint64_t h = 14695981039346656037ULL;
+	for (const unsigned char *c = (const unsigned char *) url; *c; c++) {
+		h = (h ^ *c) * 1099511628211ULL;
+	}
+	char *path = NULL;
+	if (asprintf (&path, "%s/%016" PRIx64 ".%s", replay_dir, h, ext) == -1) {
+		return NULL;
+	}
+	return path;
+}
+
+void replay_save (CURL *curl, const char *url, CURLcode code, long http_code,
+		const string_t *res)
+{
+	if (replay_mode != REPLAY_RECORD) {
+		return;
+	}
+
+	double total = 0;
+	curl_easy_getinfo (curl, CURLINFO_TOTAL_TIME, &total);
+	char *meta_path = replay_path (url, "meta");
+	char *body_path = replay_path (url, "body");
+	if (!meta_path || !body_path) {
+		free (meta_path);
+		free (body_path);
+		return;
+	}
+	FILE *meta = fopen (meta_path, "w");
+	FILE *body = (meta) ? fopen (body_path, "wb") : NULL;
+	if (!body) {
+		perror ((meta) ? body_path : meta_path);
+	} else {
+		fprintf (meta, "url %s\ncurl_code %d\nhttp_code %ld\ntotal_us %ld\n",
+				url, (int) code, http_code, (long) (total * 1e6));
+		fwrite (res->s, 1, res->used, body);
+	}
+	if (meta) {
+		fclose (meta);
+	}
+	if (body) {
+		fclose (body);
+	}
+	free (meta_path);
+	free (body_path);
+}
+
+static bool replay_read_body (const char *path, string_t *res)
+{
+	FILE *body = fopen (path, "rb");
+	if (!body) {
+		perror (path);
+		return false;
+	}
+	char buf[65536];
+	size_t n;
+	while ((n = fread (buf, 1, sizeof (buf), body)) > 0) {
+		string_ncat (res, buf, n);
+	}
+	fclose (body);
+	return true;
+}
+
+CURLcode replay_fetch (const char *url, string_t *res, long *http_code)
+{
+	*http_code = 0;
+	char *meta_path = replay_path (url, "meta");
+	char *body_path = replay_path (url, "body");
+	FILE *meta = (meta_path) ? fopen (meta_path, "r") : NULL;
+	bool found = false;
+	int curl_code = CURLE_OK;
+	long total_us = 0;
+
+	if (meta) {
+		char *line = NULL;
+		size_t size = 0;
+		ssize_t len;
+		while ((len = getline (&line, &size, meta)) > 0) {
+			if (line[len - 1] == '\n') {
+				line[len - 1] = '\0';
+			}
+			char *value = strchr (line, ' ');
+			if (!value) {
+				continue;
+			}
+			*(value++) = '\0';
+			if (strcmp (line, "url") == 0) {
+				/* the hash of another URL */
+				found = (strcmp (value, url) == 0);
+			} else if (strcmp (line, "curl_code") == 0) {
+				curl_code = atoi (value);
+			} else if (strcmp (line, "http_code") == 0) {
+				*http_code = strtol (value, NULL, 10);
+			} else if (strcmp (line, "total_us") == 0) {
+				total_us = strtol (value, NULL, 10);
+			}
+		}
+		free (line);
+		fclose (meta);
+	}
+	if (found) {
+		found = replay_read_body (body_path, res);
+	}
+	free (meta_path);
+	free (body_path);
+	if (!found) {
+		fprintf (stderr, "replay: no recorded response for %s\n", url);
+		*http_code = 0;
+		return CURLE_REMOTE_FILE_NOT_FOUND;
+	}
+
+	/* as long as the recorded request */
+	if (total_us > 0) {
+		struct timespec ts;
+		ts.tv_sec = total_us / 1000000;
+		ts.tv_nsec = (total_us % 1000000) * 1000;
+		while (nanosleep (&ts, &ts) == -1 && errno == EINTR) {
+			continue;
+		}
+	}
+	return (CURLcode) curl_code;
+}
+
+void replay_cleanup (void)
+{
+	FREE (replay_dir);
+	replay_mode = REPLAY_OFF;
+}
+
+/* vim: set ts=4 sw=4 noet: */
@@ -0,0 +1,47 @@
+/*
+ *  replay.h
+ *
+ *  Copyright (c) 2010-2012 Tuxce <tuxce.net@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PQ_REPLAY_H
+#define PQ_REPLAY_H
+
+#include <stdbool.h>
+#include <curl/curl.h>
+
+#include "util.h"
+
+/* replay_record() saves each HTTP exchange in dir from now on,
+ * replay_serve() answers the requests from a recorded dir instead */
+void replay_record (const char *dir);
+void replay_serve (const char *dir);
+
+/* replay_serving() is true when requests must go to replay_fetch() */
+bool replay_serving (void);
+
+/* replay_fetch() appends the recorded body of url to res, after the
+ * recorded time, and returns the recorded codes */
+CURLcode replay_fetch (const char *url, string_t *res, long *http_code);
+
+/* replay_save() records the transfer curl just did */
+void replay_save (CURL *curl, const char *url, CURLcode code, long http_code,
+		const string_t *res);
+
+void replay_cleanup (void);
+
+#endif
+
+/* vim: set ts=4 sw=4 noet: */
@@ -0,0 +1,489 @@
+/*
+ *  stats.c
+ *
+ *  Copyright (c) 2010-2012 Tuxce <tuxce.net@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <yajl/yajl_gen.h>
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#include "util.h"
+#include "stats.h"
+
+#define STATS_MAX_DEPTH 16
+
+static const char *stats_phase_names[] =
+{
+	"config",
+	"alpm",
+	"db",
+	"curl",
+	"json",
+	"relevance",
+	"sort",
+	"output"
+};
+
+/* Hardware counters of --hwstats */
+typedef enum
+{
+	HW_CYCLES = 0,
+	HW_INSTRUCTIONS,
+	HW_CACHE_MISSES,
+	HW_BRANCH_MISSES,
+	HW_LAST
+} stathw_t;
+
+static const char *stats_hw_names[] =
+{
+	"cycles",
+	"instructions",
+	"cache misses",
+	"branch misses"
+};
+
+static const char *stats_counter_names[] =
+{
+	"packages scanned",
+	"results emitted"
+};
+
+typedef struct _statentry_t
+{
+	statphase_t phase;
+	char *label;
+	unsigned long calls;
+	/* time spent in the phase itself, nested spans excluded */
+	double wall;
+	double cpu;
+	double hw[HW_LAST];
+} statentry_t;
+
+typedef struct _statspan_t
+{
+	size_t entry;
+	double wall;
+	double cpu;
+	/* time spent in nested spans */
+	double child_wall;
+	double child_cpu;
+	double hw[HW_LAST];
+	double child_hw[HW_LAST];
+	char *note;
+} statspan_t;
+
+/* A complete span for --trace, times in seconds since stats_start_wall */
+typedef struct _statevent_t
+{
+	size_t entry;
+	int tid;
+	double start;
+	double dur;
+	char *note;
+} statevent_t;
+
+static bool stats_enabled = false;
+static bool stats_summary = false;
+static char *trace_path = NULL;
+static double stats_start_wall;
+static double stats_start_cpu;
+/* entries and events are shared by all threads */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static statentry_t *entries = NULL;
+static size_t entries_count = 0;
+static statevent_t *events = NULL;
+static size_t events_count = 0;
+static size_t events_size = 0;
+static int threads_count = 0;
+static unsigned long counters[SC_LAST];
+/* perf events of the main thread, inherited by the threads it creates */
+static int hw_fds[HW_LAST] = {-1, -1, -1, -1};
+static bool hw_enabled = false;
+
+/*
+ * Each thread has its own span stack, the main thread is 0, others get
+ * an id on their first span. Only the main thread spans are added up in
+ * the summary, the other ones run within one of its spans.
+ */
+static __thread int stats_tid = -1;
+static __thread statspan_t spans[STATS_MAX_DEPTH];
+static __thread int spans_depth = 0;
+/* spans deeper than STATS_MAX_DEPTH are not timed */
+static __thread int spans_skipped = 0;
+
+static double stats_clock (clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime (clock, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void stats_enable (void)
+{
+	if (stats_enabled) {
+		return;
+	}
+	stats_enabled = true;
+	stats_tid = 0;
+	threads_count = 1;
+	stats_start_wall = stats_clock (CLOCK_MONOTONIC);
+	stats_start_cpu = stats_clock (CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void stats_init (void)
+{
+	stats_enable ();
+	stats_summary = true;
+}
+
+static void stats_hw_close (void)
+{
+	for (stathw_t hw = 0; hw < HW_LAST; hw++) {
+		if (hw_fds[hw] != -1) {
+			close (hw_fds[hw]);
+			hw_fds[hw] = -1;
+		}
+	}
+	hw_enabled = false;
+}
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+static int stats_hw_open (stathw_t hw)
+{
+	static const unsigned long long configs[] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES
+	};
+	struct perf_event_attr attr;
+	memset (&attr, 0, sizeof (attr));
+	attr.size = sizeof (attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = configs[hw];
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.inherit = 1;
+	/* counters may be multiplexed, values are scaled by these times */
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return syscall (SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+void stats_hw_init (void)
+{
+	stats_init ();
+#ifdef HAVE_LINUX_PERF_EVENT_H
+	for (stathw_t hw = 0; hw < HW_LAST; hw++) {
+		if ((hw_fds[hw] = stats_hw_open (hw)) == -1) {
+			perror ("perf_event_open");
+			fprintf (stderr, "hardware counters are not available (see /proc/sys/kernel/perf_event_paranoid)\n");
+			stats_hw_close ();
+			return;
+		}
+	}
+	hw_enabled = true;
+#else
+	fprintf (stderr, "hardware counters are not supported by this build\n");
+#endif
+}
+
+static void stats_hw_read (double *v)
+{
+	for (stathw_t hw = 0; hw < HW_LAST; hw++) {
+		uint64_t r[3];
+		v[hw] = 0;
+		if (read (hw_fds[hw], r, sizeof (r)) == sizeof (r) && r[2]) {
+			v[hw] = (double) r[0] * r[1] / r[2];
+		}
+	}
+}
+
+void stats_trace (const char *path)
+{
+	stats_enable ();
+	FREE (trace_path);
+	trace_path = strdup (path);
+}
+
+static size_t stats_entry (statphase_t phase, const char *label)
+{
+	for (size_t i = 0; i < entries_count; i++) {
+		if (entries[i].phase == phase && ((!label && !entries[i].label)
+				|| (label && entries[i].label && strcmp (label, entries[i].label) == 0))) {
+			return i;
+		}
+	}
+	REALLOC (entries, (entries_count + 1) * sizeof (statentry_t));
+	statentry_t *e = &(entries[entries_count]);
+	memset (e, 0, sizeof (statentry_t));
+	e->phase = phase;
+	e->label = STRDUP (label);
+	return entries_count++;
+}
+
+static void stats_add_event (const statspan_t *s, double wall)
+{
+	if (events_count == events_size) {
+		events_size = (events_size) ? events_size * 2 : 256;
+		REALLOC (events, events_size * sizeof (statevent_t));
+	}
+	statevent_t *ev = &(events[events_count++]);
+	ev->entry = s->entry;
+	ev->tid = stats_tid;
+	ev->start = s->wall - stats_start_wall;
+	ev->dur = wall - s->wall;
+	ev->note = s->note;
+}
+
+void stats_begin (statphase_t phase, const char *label)
+{
+#ifdef ENABLE_ALLOC_STATS
+	alloc_push_phase (stats_phase_names[phase]);
+#endif
+	if (!stats_enabled) {
+		return;
+	}
+	if (spans_depth == STATS_MAX_DEPTH) {
+		spans_skipped++;
+		return;
+	}
+	pthread_mutex_lock (&stats_lock);
+	if (stats_tid < 0) {
+		stats_tid = threads_count++;
+	}
+	statspan_t *s = &(spans[spans_depth++]);
+	s->entry = stats_entry (phase, label);
+	pthread_mutex_unlock (&stats_lock);
+	s->child_wall = s->child_cpu = 0;
+	s->note = NULL;
+	if (hw_enabled && stats_tid == 0) {
+		memset (s->child_hw, 0, sizeof (s->child_hw));
+		stats_hw_read (s->hw);
+	}
+	s->cpu = stats_clock (CLOCK_PROCESS_CPUTIME_ID);
+	s->wall = stats_clock (CLOCK_MONOTONIC);
+}
+
+void stats_end (void)
+{
+#ifdef ENABLE_ALLOC_STATS
+	alloc_pop_phase ();
+#endif
+	if (!stats_enabled) {
+		return;
+	}
+	if (spans_skipped) {
+		spans_skipped--;
+		return;
+	}
+	if (!spans_depth) {
+		return;
+	}
+	const double wall = stats_clock (CLOCK_MONOTONIC);
+	const double cpu = stats_clock (CLOCK_PROCESS_CPUTIME_ID);
+	statspan_t *s = &(spans[--spans_depth]);
+	double hw[HW_LAST];
+	const bool with_hw = (hw_enabled && stats_tid == 0);
+	if (with_hw) {
+		stats_hw_read (hw);
+	}
+	pthread_mutex_lock (&stats_lock);
+	if (trace_path) {
+		stats_add_event (s, wall);
+	} else {
+		FREE (s->note);
+	}
+	if (stats_tid == 0) {
+		statentry_t *e = &(entries[s->entry]);
+		e->calls++;
+		e->wall += (wall - s->wall) - s->child_wall;
+		e->cpu += (cpu - s->cpu) - s->child_cpu;
+		for (stathw_t i = 0; with_hw && i < HW_LAST; i++) {
+			e->hw[i] += (hw[i] - s->hw[i]) - s->child_hw[i];
+		}
+	}
+	pthread_mutex_unlock (&stats_lock);
+	if (spans_depth) {
+		spans[spans_depth - 1].child_wall += wall - s->wall;
+		spans[spans_depth - 1].child_cpu += cpu - s->cpu;
+		for (stathw_t i = 0; with_hw && i < HW_LAST; i++) {
+			spans[spans_depth - 1].child_hw[i] += hw[i] - s->hw[i];
+		}
+	}
+}
+
+void stats_note (const char *note)
+{
+	if (!trace_path || spans_skipped || !spans_depth) {
+		return;
+	}
+	statspan_t *s = &(spans[spans_depth - 1]);
+	FREE (s->note);
+	s->note = STRDUP (note);
+}
+
+void stats_count (statcounter_t counter, unsigned long n)
+{
+	if (stats_enabled) {
+		counters[counter] += n;
+	}
+}
+
+static void stats_print_cb (void *ctx, const char *str, size_t len)
+{
+	fwrite (str, 1, len, (FILE *) ctx);
+}
+
+static void stats_gen_thread_name (yajl_gen g, int tid, const char *name)
+{
+	yajl_gen_map_open (g);
+	json_gen_str (g, "name", "thread_name");
+	json_gen_str (g, "ph", "M");
+	json_gen_int (g, "pid", getpid ());
+	json_gen_int (g, "tid", tid);
+	json_gen_key (g, "args");
+	yajl_gen_map_open (g);
+	json_gen_str (g, "name", name);
+	yajl_gen_map_close (g);
+	yajl_gen_map_close (g);
+}
+
+/*
+ * Trace Event Format (chrome://tracing, ui.perfetto.dev): one complete
+ * event ("ph": "X") per span, in microseconds.
+ */
+static void stats_write_trace (void)
+{
+	FILE *out = (strcmp (trace_path, "-") == 0) ? stderr : fopen (trace_path, "w");
+	if (!out) {
+		perror (trace_path);
+		return;
+	}
+	const long long pid = getpid ();
+	yajl_gen g = yajl_gen_alloc (NULL);
+	yajl_gen_config (g, yajl_gen_print_callback, stats_print_cb, out);
+	yajl_gen_map_open (g);
+	json_gen_str (g, "displayTimeUnit", "ms");
+	json_gen_key (g, "traceEvents");
+	yajl_gen_array_open (g);
+	stats_gen_thread_name (g, 0, "main");
+	for (int tid = 1; tid < threads_count; tid++) {
+		char name[32];
+		snprintf (name, sizeof (name), "worker %d", tid);
+		stats_gen_thread_name (g, tid, name);
+	}
+	for (size_t i = 0; i < events_count; i++) {
+		const statevent_t *ev = &(events[i]);
+		const statentry_t *e = &(entries[ev->entry]);
+		yajl_gen_map_open (g);
+		json_gen_str (g, "name", (e->label) ? e->label : stats_phase_names[e->phase]);
+		json_gen_str (g, "cat", stats_phase_names[e->phase]);
+		json_gen_str (g, "ph", "X");
+		json_gen_int (g, "pid", pid);
+		json_gen_int (g, "tid", ev->tid);
+		json_gen_double (g, "ts", ev->start * 1e6);
+		json_gen_double (g, "dur", ev->dur * 1e6);
+		if (ev->note) {
+			json_gen_key (g, "args");
+			yajl_gen_map_open (g);
+			json_gen_str (g, "note", ev->note);
+			yajl_gen_map_close (g);
+		}
+		yajl_gen_map_close (g);
+	}
+	yajl_gen_array_close (g);
+	yajl_gen_map_close (g);
+	yajl_gen_free (g);
+	fputc ('\n', out);
+	if (out != stderr) {
+		fclose (out);
+	}
+}
+
+static void stats_print_summary (void)
+{
+	const double wall = stats_clock (CLOCK_MONOTONIC) - stats_start_wall;
+	const double cpu = stats_clock (CLOCK_PROCESS_CPUTIME_ID) - stats_start_cpu;
+
+	fprintf (stderr, "%-24s %8s %12s %12s", "phase", "calls", "wall (ms)", "cpu (ms)");
+	for (stathw_t hw = 0; hw_enabled && hw < HW_LAST; hw++) {
+		fprintf (stderr, " %14s", stats_hw_names[hw]);
+	}
+	fputc ('\n', stderr);
+	for (statphase_t p = 0; p < ST_LAST; p++) {
+		for (size_t i = 0; i < entries_count; i++) {
+			const statentry_t *e = &(entries[i]);
+			if (e->phase != p || !e->calls) {
+				continue;
+			}
+			char name[64];
+			snprintf (name, sizeof (name), "%s%s%s", stats_phase_names[p],
+					(e->label) ? " " : "", (e->label) ? e->label : "");
+			fprintf (stderr, "%-24s %8lu %12.3f %12.3f", name, e->calls,
+					e->wall * 1e3, e->cpu * 1e3);
+			for (stathw_t hw = 0; hw_enabled && hw < HW_LAST; hw++) {
+				fprintf (stderr, " %14.0f", e->hw[hw]);
+			}
+			fputc ('\n', stderr);
+		}
+	}
+	fprintf (stderr, "%-24s %8s %12.3f %12.3f\n", "total", "", wall * 1e3, cpu * 1e3);
+	for (statcounter_t c = 0; c < SC_LAST; c++) {
+		fprintf (stderr, "%s: %lu\n", stats_counter_names[c], counters[c]);
+	}
+}
+
+void stats_report (void)
+{
+	if (!stats_enabled) {
+		return;
+	}
+	if (stats_summary) {
+		stats_print_summary ();
+	}
+	stats_hw_close ();
+	if (trace_path) {
+		stats_write_trace ();
+	}
+
+	for (size_t i = 0; i < events_count; i++) {
+		FREE (events[i].note);
+	}
+	FREE (events);
+	events_count = events_size = 0;
+	FREE (trace_path);
+	for (size_t i = 0; i < entries_count; i++) {
+		FREE (entries[i].label);
+	}
+	FREE (entries);
+	entries_count = 0;
+	stats_enabled = stats_summary = false;
+}
+
+/* vim: set ts=4 sw=4 noet: */
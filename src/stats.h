@@ -0,0 +1,75 @@
+/*
+ *  stats.h
+ *
+ *  Copyright (c) 2010-2012 Tuxce <tuxce.net@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PQ_STATS_H
+#define PQ_STATS_H
+
+/*
+ * Phases timed by --stats, see stats_phase_names in stats.c
+ */
+typedef enum
+{
+	ST_CONFIG = 0,
+	ST_ALPM,
+	ST_DB,
+	ST_CURL,
+	ST_JSON,
+	ST_RELEVANCE,
+	ST_SORT,
+	ST_OUTPUT,
+	ST_LAST
+} statphase_t;
+
+typedef enum
+{
+	SC_SCANNED = 0,
+	SC_RESULTS,
+	SC_LAST
+} statcounter_t;
+
+/* stats_init() enables the stats, they cost nothing until then */
+void stats_init (void);
+
+/* stats_hw_init() also counts cycles, instructions, cache and branch
+ * misses per phase, when perf events are available */
+void stats_hw_init (void);
+
+/* stats_trace() records every span to write them to path ("-" for
+ * stderr) as Chrome trace events */
+void stats_trace (const char *path);
+
+/*
+ * stats_begin()/stats_end() delimit a span of the given phase, label
+ * (may be NULL) splits a phase, e.g. by database. Spans nest, the time
+ * spent in a nested span is not counted in its parent.
+ */
+void stats_begin (statphase_t phase, const char *label);
+void stats_end (void);
+
+/* stats_note() attaches a note (e.g. an URL) to the current span in the
+ * trace */
+void stats_note (const char *note);
+
+void stats_count (statcounter_t counter, unsigned long n);
+
+/* stats_report() prints the stats to stderr and writes the trace */
+void stats_report (void);
+
+#endif
+
+/* vim: set ts=4 sw=4 noet: */
@@ -0,0 +1,155 @@
+/*
+ *  strdist.c
+ *
+ *  Copyright (c) 2010-2012 Tuxce <tuxce.net@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+#include <stdint.h>
+#include <string.h>
+
+#include "util.h"
+#include "strdist.h"
+
+/*
+ * Bit-parallel string distances: one bit per pattern character, 64
+ * pattern characters per word. Each character of the compared string
+ * updates a whole DP column with a few word operations, in memory
+ * linear to the pattern length.
+ */
+
+#define WORD_BITS 64
+#define WORD_HIGH_BIT ((uint64_t) 1 << (WORD_BITS - 1))
+
+struct _strpat_t
+{
+	size_t len;
+	size_t blocks;
+	/* 1 in peq[c * blocks + b] at bit i if s[b * WORD_BITS + i] == c */
+	uint64_t peq[];
+};
+
+strpat_t *strpat_new (const char *s)
+{
+	const size_t len = strlen (s);
+	const size_t blocks = (len + WORD_BITS - 1) / WORD_BITS;
+	strpat_t *p;
+	MALLOC (p, sizeof (strpat_t) + 256 * blocks * sizeof (uint64_t));
+	p->len = len;
+	p->blocks = blocks;
+	for (size_t i = 0; i < len; i++) {
+		const unsigned char c = s[i];
+		p->peq[c * blocks + i / WORD_BITS] |= (uint64_t) 1 << (i % WORD_BITS);
+	}
+	return p;
+}
+
+void strpat_free (strpat_t *p)
+{
+	FREE (p);
+}
+
+/*
+ * Advance one block of the Levenshtein column by one character
+ * (Myers 1999, Hyyrö 2003). hin/return value are the horizontal deltas
+ * entering the block's first row and leaving its row at out_bit.
+ */
+static inline int lev_advance_block (uint64_t *pv, uint64_t *mv, uint64_t eq,
+		int hin, uint64_t out_bit)
+{
+	const uint64_t hin_neg = (hin < 0);
+	const uint64_t hin_pos = (hin > 0);
+	const uint64_t xv = eq | *mv;
+	eq |= hin_neg;
+	const uint64_t xh = (((eq & *pv) + *pv) ^ *pv) | eq;
+	uint64_t ph = *mv | ~(xh | *pv);
+	uint64_t mh = *pv & xh;
+	const int hout = ((ph & out_bit) != 0) - ((mh & out_bit) != 0);
+	ph = (ph << 1) | hin_pos;
+	mh = (mh << 1) | hin_neg;
+	*pv = mh | ~(xv | ph);
+	*mv = ph & xv;
+	return hout;
+}
+
+size_t strpat_levenshtein (const strpat_t *p, const char *s)
+{
+	const size_t blocks = p->blocks;
+	if (p->len == 0) {
+		return strlen (s);
+	}
+
+	uint64_t vec[2 * blocks];
+	uint64_t *pv = vec, *mv = vec + blocks;
+	for (size_t b = 0; b < blocks; b++) {
+		pv[b] = ~(uint64_t) 0;
+		mv[b] = 0;
+	}
+	/* rows past the pattern end in the last block never reach the
+	 * rows above, only the delta of the last real row is tracked */
+	const uint64_t last_bit = (uint64_t) 1 << ((p->len - 1) % WORD_BITS);
+	size_t score = p->len;
+	for (; *s; s++) {
+		const uint64_t *eq = p->peq + (unsigned char) *s * blocks;
+		int h = 1;
+		for (size_t b = 0; b + 1 < blocks; b++) {
+			h = lev_advance_block (&pv[b], &mv[b], eq[b], h, WORD_HIGH_BIT);
+		}
+		score += lev_advance_block (&pv[blocks - 1], &mv[blocks - 1],
+				eq[blocks - 1], h, last_bit);
+	}
+	return score;
+}
+
+/*
+ * LCS length (Allison-Dix 1986, Hyyrö 2004): zero bits of v mark the
+ * rows where the LCS grows, the addition carry runs across blocks.
+ */
+size_t strpat_lcs (const strpat_t *p, const char *s)
+{
+	const size_t blocks = p->blocks;
+	if (p->len == 0) {
+		return 0;
+	}
+
+	uint64_t v[blocks];
+	for (size_t b = 0; b < blocks; b++) {
+		v[b] = ~(uint64_t) 0;
+	}
+	for (; *s; s++) {
+		const uint64_t *eq = p->peq + (unsigned char) *s * blocks;
+		uint64_t carry = 0;
+		for (size_t b = 0; b < blocks; b++) {
+			const uint64_t u = v[b] & eq[b];
+			uint64_t sum;
+			const uint64_t c1 = __builtin_add_overflow (v[b], u, &sum);
+			const uint64_t c2 = __builtin_add_overflow (sum, carry, &sum);
+			carry = c1 | c2;
+			v[b] = sum | (v[b] - u);
+		}
+	}
+
+	size_t lcs = 0;
+	for (size_t b = 0; b < blocks; b++) {
+		uint64_t zeros = ~v[b];
+		if (b == blocks - 1 && p->len % WORD_BITS) {
+			zeros &= ((uint64_t) 1 << (p->len % WORD_BITS)) - 1;
+		}
+		lcs += __builtin_popcountll (zeros);
+	}
+	return lcs;
+}
+
+/* vim: set ts=4 sw=4 noet: */
@@ -0,0 +1,42 @@
+/*
+ *  strdist.h
+ *
+ *  Copyright (c) 2010-2012 Tuxce <tuxce.net@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef PQ_STRDIST_H
+#define PQ_STRDIST_H
+
+#include <stddef.h>
+
+/*
+ * Pattern with its match bit-vectors, built once and compared
+ * against many strings. Read-only once built, so it can be shared
+ * between threads.
+ */
+typedef struct _strpat_t strpat_t;
+
+strpat_t *strpat_new (const char *s);
+void strpat_free (strpat_t *p);
+
+/* Levenshtein distance between pattern and s */
+size_t strpat_levenshtein (const strpat_t *p, const char *s);
+
+/* Length of the longest common subsequence of pattern and s */
+size_t strpat_lcs (const strpat_t *p, const char *s);
+
+#endif
+
+/* vim: set ts=4 sw=4 noet: */
@@ -18,32 +18,38 @@
  */
 #include "config.h"
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include <regex.h>
 #include <float.h>
+#include <math.h>
 #include <limits.h>
+#include <stdint.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "util.h"
 #include "alpm-query.h"
 #include "aur.h"
 #include "color.h"
+#include "strdist.h"
+#include "stats.h"
+#include "netstats.h"
+#include "replay.h"
+#include "probes.h"
 
 #define FORMAT_LOCAL_PKG "lF134"
 #define INDENT 4
 
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
-#define MIN3(a, b, c) ((a) < (b) ? ((a) < (c) ? (a) : (c)) : ((b) < (c) ? (b) : (c)))
 
 /* User agent */
 #define PQ_USERAGENT "package-query/" PACKAGE_VERSION
 
-typedef alpm_list_t *(*alpm_list_nav)(const alpm_list_t *);
-
 /* curl init config */
 typedef struct _curl_config_t
 {
@@ -53,41 +59,52 @@ typedef struct _curl_config_t
 
 static curl_config_t curl_config = {NULL, -1};
 
-static alpm_list_t *results = NULL;
+static yajl_gen json_out = NULL;
+
+/* Results
+ * Stored in a contiguous array, each entry carries its sort key
+ * computed once when it is added.
+ */
+/* An arena handed over by results_own_arena(), with the number of
+ * results pointing to it: freed as soon as it drops to 0 */
+typedef struct _resultsarena_t
+{
+	arena_t *arena;
+	size_t live;
+} resultsarena_t;
 
-/* Results */
 typedef struct _results_t
 {
 	void *ele;
+	resultsarena_t *owner;
+	const char *name;
+	uint64_t key;
+	size_t seq;
 	double rel;
 	pkgtype_t type;
 } results_t;
 
-static results_t *results_new (const void *ele, pkgtype_t type)
-{
-	results_t *r = NULL;
-	MALLOC (r, sizeof (results_t));
-	r->ele = (void *) ((type == R_AUR_PKG) ? aur_pkg_dup ((const aurpkg_t *) ele) : ele);
-	r->rel = DBL_MAX;
-	r->type = type;
-	return r;
-}
+static results_t *results = NULL;
+static size_t results_count = 0;
+static size_t results_size = 0;
+static size_t results_seq = 0;
+/* arenas holding the AUR packages of results, and the one of the
+ * packages being added */
+static alpm_list_t *results_arenas = NULL;
+static resultsarena_t *results_filling = NULL;
+
+#define RESULTS_MIN_SIZE 64
 
-static void results_free (results_t *r)
+/* Map a double to an integer with the same ordering */
+static uint64_t double_key (double d)
 {
-	if (r) {
-		if (r->type == R_AUR_PKG) {
-			aur_pkg_free (r->ele);
-		}
-		free (r);
-	}
+	uint64_t bits;
+	memcpy (&bits, &d, sizeof (bits));
+	return (bits & (1ULL << 63)) ? ~bits : bits | (1ULL << 63);
 }
 
 static const char *results_name (const results_t *r)
 {
-	if (!r) {
-		return NULL;
-	}
 	switch (r->type) {
 		case R_ALPM_PKG:
 			return alpm_pkg_get_name ((alpm_pkg_t *) r->ele);
@@ -100,21 +117,16 @@ static const char *results_name (const results_t *r)
 
 static time_t results_installdate (const results_t *r)
 {
-	if (!r || r->type == R_AUR_PKG) {
+	if (r->type == R_AUR_PKG || !r->name) {
 		return 0;
 	}
-	time_t idate = 0;
-	const char *r_name = results_name (r);
-	alpm_pkg_t *pkg = alpm_db_get_pkg (alpm_get_localdb (config.handle), r_name);
-	if (pkg) {
-		idate = alpm_pkg_get_installdate (pkg);
-	}
-	return idate;
+	alpm_pkg_t *pkg = alpm_db_get_pkg (alpm_get_localdb (config.handle), r->name);
+	return (pkg) ? alpm_pkg_get_installdate (pkg) : 0;
 }
 
 static off_t results_isize (const results_t *r)
 {
-	if (!r || r->type == R_AUR_PKG) {
+	if (r->type == R_AUR_PKG) {
 		return 0;
 	}
 	return alpm_pkg_get_isize ((alpm_pkg_t *) r->ele);
@@ -122,7 +134,7 @@ static off_t results_isize (const results_t *r)
 
 static unsigned int results_votes (const results_t *r)
 {
-	if (!r || r->type != R_AUR_PKG) {
+	if (r->type != R_AUR_PKG) {
 		return UINT_MAX; // put ALPM packages on top
 	}
 	return aur_pkg_get_votes ((const aurpkg_t *) r->ele);
@@ -130,186 +142,365 @@ static unsigned int results_votes (const results_t *r)
 
 static double results_popularity (const results_t *r)
 {
-	if (!r || r->type != R_AUR_PKG) {
+	if (r->type != R_AUR_PKG) {
 		return DBL_MAX; // put ALPM packages on top
 	}
 	return aur_pkg_get_popularity ((const aurpkg_t *) r->ele);
 }
 
-static double results_relevance (const results_t *r)
+/* Sort key, results are sorted by ascending key */
+static uint64_t results_key (const results_t *r)
 {
-	return r ? r->rel : DBL_MAX;
+	switch (config.sort) {
+		case S_VOTE:  return UINT_MAX - results_votes (r);
+		case S_POP:   return ~double_key (results_popularity (r));
+		case S_REL:   return double_key (r->rel);
+		case S_IDATE: return (uint64_t) results_installdate (r);
+		case S_ISIZE: return (uint64_t) results_isize (r);
+		default:      return 0;
+	}
 }
 
 static int results_cmp (const void *r1, const void *r2)
 {
-	const char *r1name = results_name ((const results_t *) r1);
-	const char *r2name = results_name ((const results_t *) r2);
+	const char *r1name = ((const results_t *) r1)->name;
+	const char *r2name = ((const results_t *) r2)->name;
 	if (!r1name || !r2name) {
 		return 0;
 	}
 	return strcmp (r1name, r2name);
 }
 
-static int results_installdate_cmp (const void *r1, const void *r2)
+static int results_seq_cmp (const void *r1, const void *r2)
 {
-	const time_t idate1 = results_installdate ((const results_t *) r1);
-	const time_t idate2 = results_installdate ((const results_t *) r2);
-	if (idate1 > idate2) return 1;
-	if (idate2 > idate1) return -1;
-	return 0;
+	const size_t seq1 = ((const results_t *) r1)->seq;
+	const size_t seq2 = ((const results_t *) r2)->seq;
+	return (seq1 > seq2) - (seq1 < seq2);
 }
 
-static int results_isize_cmp (const void *r1, const void *r2)
+/* Output order of results: < 0 if r1 is shown before r2 */
+static int results_order (const results_t *r1, const results_t *r2)
 {
-	const off_t isize1 = results_isize ((const results_t *) r1);
-	const off_t isize2 = results_isize ((const results_t *) r2);
-	if (isize1 > isize2) return 1;
-	if (isize2 > isize1) return -1;
-	return 0;
+	int ret = (config.sort == S_NAME)
+		? results_cmp (r1, r2)
+		: (r1->key > r2->key) - (r1->key < r2->key);
+	if (!ret) {
+		ret = results_seq_cmp (r1, r2);
+	}
+	return (config.rsort) ? -ret : ret;
 }
 
-static int results_votes_cmp (const void *r1, const void *r2)
+/* With --limit, results are kept in a bounded heap with the last one
+ * to be shown on top. Relevance is only known once every result is in,
+ * so this sort is bounded at output.
+ */
+static bool results_heap (void)
 {
-	return (results_votes ((const results_t *) r2) - results_votes ((const results_t *) r1));
+	return config.limit && config.sort != S_REL;
 }
 
-static int results_popularity_cmp (const void *r1, const void *r2)
+static void results_heap_swap (size_t i, size_t j)
 {
-	const double pop1 = results_popularity ((const results_t *) r1);
-	const double pop2 = results_popularity ((const results_t *) r2);
-	if (pop1 > pop2) return -1;
-	if (pop2 > pop1) return 1;
-	return 0;
+	const results_t t = results[i];
+	results[i] = results[j];
+	results[j] = t;
 }
 
-static int results_relevance_cmp (const void *r1, const void *r2)
+static void results_sift_up (size_t i)
 {
-	const double rel1 = results_relevance ((const results_t *) r1);
-	const double rel2 = results_relevance ((const results_t *) r2);
-	if (rel1 > rel2) return 1;
-	if (rel2 > rel1) return -1;
-	return 0;
+	while (i > 0) {
+		const size_t parent = (i - 1) / 2;
+		if (results_order (&(results[parent]), &(results[i])) >= 0) {
+			break;
+		}
+		results_heap_swap (i, parent);
+		i = parent;
+	}
+}
+
+static void results_sift_down (size_t i)
+{
+	while (true) {
+		const size_t l = 2 * i + 1, r = l + 1;
+		size_t last = i;
+		if (l < results_count && results_order (&(results[l]), &(results[last])) > 0) {
+			last = l;
+		}
+		if (r < results_count && results_order (&(results[r]), &(results[last])) > 0) {
+			last = r;
+		}
+		if (last == i) {
+			break;
+		}
+		results_heap_swap (i, last);
+		i = last;
+	}
 }
 
-// https://en.wikibooks.org/wiki/Algorithm_Implementation/Strings/Levenshtein_distance#C
-static size_t levenshtein_distance (const char *s1, const char *s2)
+static void results_arena_unref (resultsarena_t *owner)
 {
-	const size_t s1len = strlen (s1);
-	const size_t s2len = strlen (s2);
-	if (s1len == 0) {
-		return s2len;
+	/* the arena being filled still holds packages to be added */
+	if (owner && --(owner->live) == 0 && owner != results_filling) {
+		arena_free (owner->arena);
+		owner->arena = NULL;
 	}
-	if (s2len == 0) {
-		return s1len;
+}
+
+static void results_add (const void *ele, pkgtype_t type)
+{
+	results_t r;
+	r.ele = (void *) ele;
+	r.owner = (type == R_AUR_PKG) ? results_filling : NULL;
+	r.type = type;
+	r.rel = DBL_MAX;
+	r.seq = results_seq++;
+	r.name = results_name (&r);
+	r.key = results_key (&r);
+
+	if (results_heap () && results_count == config.limit) {
+		if (results_order (&r, &(results[0])) >= 0) {
+			/* would not be shown */
+			return;
+		}
+		resultsarena_t *out = results[0].owner;
+		if (r.owner) {
+			r.owner->live++;
+		}
+		results[0] = r;
+		results_sift_down (0);
+		results_arena_unref (out);
+		return;
 	}
 
-	size_t column[s1len + 1];
-	for (size_t x = 1; x <= s1len; x++) {
-		column[x] = x;
+	if (results_count == results_size) {
+		results_size = (results_size) ? results_size * 2 : RESULTS_MIN_SIZE;
+		REALLOC (results, results_size * sizeof (results_t));
 	}
-	for (size_t x = 1; x <= s2len; x++) {
-		column[0] = x;
-		size_t lastdiag = x - 1;
-		for (size_t y = 1; y <= s1len; y++) {
-			const size_t olddiag = column[y];
-			column[y] = MIN3 (column[y] + 1, column[y-1] + 1, lastdiag + (s1[y-1] == s2[x-1] ? 0 : 1));
-			lastdiag = olddiag;
+	if (r.owner) {
+		r.owner->live++;
+	}
+	results[results_count] = r;
+	results_count++;
+	if (results_heap ()) {
+		results_sift_up (results_count - 1);
+	}
+}
+
+void results_free (void)
+{
+	for (alpm_list_t *i = results_arenas; i; i = alpm_list_next (i)) {
+		resultsarena_t *owner = i->data;
+		if (owner->arena) {
+			arena_free (owner->arena);
 		}
+		FREE (owner);
 	}
+	alpm_list_free (results_arenas);
+	results_arenas = NULL;
+	results_filling = NULL;
+	FREE (results);
+	results_count = results_size = results_seq = 0;
+}
 
-	return column[s1len];
+void results_own_arena (arena_t *a)
+{
+	results_release_arena ();
+	resultsarena_t *owner;
+	MALLOC (owner, sizeof (resultsarena_t));
+	owner->arena = a;
+	owner->live = 0;
+	results_arenas = alpm_list_add (results_arenas, owner);
+	results_filling = owner;
 }
 
-// http://www.geeksforgeeks.org/dynamic-programming-set-4-longest-common-subsequence/
-static size_t longest_common_subseq (const char *s1, const char *s2)
+void results_release_arena (void)
 {
-	const size_t s1len = strlen (s1);
-	const size_t s2len = strlen (s2);
-	size_t L[s1len + 1][s2len + 1];
+	resultsarena_t *owner = results_filling;
+	results_filling = NULL;
+	/* printed, not kept, or all pushed out of the --limit heap */
+	if (owner && owner->live == 0) {
+		arena_free (owner->arena);
+		owner->arena = NULL;
+	}
+}
 
-	/* Following steps build L[m+1][n+1] in bottom up fashion. Note
-	that L[i][j] contains length of LCS of s1[0..i-1] and s2[0..j-1] */
-	for (size_t i = 0; i <= s1len; i++) {
-		for (size_t j = 0; j <= s2len; j++) {
-			if (i == 0 || j == 0) {
-				L[i][j] = 0;
-			} else if (s1[i-1] == s2[j-1]) {
-				L[i][j] = L[i-1][j-1] + 1;
-			} else {
-				L[i][j] = MAX (L[i-1][j], L[i][j-1]);
-			}
+/* Stable LSD radix sort of results by key, one byte per pass */
+static void results_radix_sort (void)
+{
+	results_t *tmp;
+	MALLOC (tmp, results_count * sizeof (results_t));
+	results_t *src = results, *dst = tmp;
+	for (unsigned int shift = 0; shift < 64; shift += 8) {
+		size_t count[256] = {0};
+		for (size_t i = 0; i < results_count; i++) {
+			count[(src[i].key >> shift) & 0xff]++;
 		}
+		/* all keys share this byte: nothing to do */
+		if (count[(src[0].key >> shift) & 0xff] == results_count) {
+			continue;
+		}
+		size_t pos = 0;
+		for (int b = 0; b < 256; b++) {
+			const size_t c = count[b];
+			count[b] = pos;
+			pos += c;
+		}
+		for (size_t i = 0; i < results_count; i++) {
+			dst[count[(src[i].key >> shift) & 0xff]++] = src[i];
+		}
+		results_t *t = src;
+		src = dst;
+		dst = t;
 	}
-
-	/* L[m][n] contains length of LCS for s1[0..n-1] and s2[0..m-1] */
-	return L[s1len][s2len];
+	if (src != results) {
+		memcpy (results, src, results_count * sizeof (results_t));
+	}
+	FREE (tmp);
 }
 
-void calculate_results_relevance (const alpm_list_t *targets)
+/* Results scored per thread, below this a single thread does it all */
+#define RELEVANCE_MIN_CHUNK 256
+
+typedef struct _relevance_job_t
 {
-	for (const alpm_list_t *t = targets; t; t = alpm_list_next (t)) {
-		const char *target = t->data;
-		for (const alpm_list_t *r = results; r; r = alpm_list_next(r)) {
-			results_t *res = (results_t *) r->data;
-			const char *res_name = results_name (res);
-			const double lev_dst = (double) levenshtein_distance (target, res_name);
+	strpat_t **pats;
+	size_t npats;
+	size_t start;
+	size_t end;
+} relevance_job_t;
+
+static void *relevance_job (void *arg)
+{
+	const relevance_job_t *job = arg;
+	stats_begin (ST_RELEVANCE, "worker");
+	for (size_t i = job->start; i < job->end; i++) {
+		results_t *res = &(results[i]);
+		for (size_t t = 0; t < job->npats; t++) {
+			const double lev_dst = (double) strpat_levenshtein (job->pats[t], res->name);
 			// calc LCS only if searching by both name and description
-			const size_t lcs = !config.name_only ? longest_common_subseq (target, res_name) : 0;
+			const size_t lcs = !config.name_only ? strpat_lcs (job->pats[t], res->name) : 0;
 			const double rel = lcs ? lev_dst / lcs : lev_dst;
 			res->rel = MIN (res->rel, rel);
 		}
+		res->key = results_key (res);
+	}
+	stats_end ();
+	return NULL;
+}
+
+void calculate_results_relevance (const alpm_list_t *targets)
+{
+	/* no target leaves rel and the keys as they were added, and pats
+	 * below must not be a zero-length array */
+	if (!results_count || !targets) {
+		return;
+	}
+
+	stats_begin (ST_RELEVANCE, NULL);
+
+	const size_t npats = alpm_list_count (targets);
+	strpat_t *pats[npats];
+	size_t n = 0;
+	for (const alpm_list_t *t = targets; t; t = alpm_list_next (t)) {
+		pats[n++] = strpat_new (t->data);
+	}
+
+	long ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+	size_t nthreads = (ncpu > 1) ? (size_t) ncpu : 1;
+	nthreads = MIN (nthreads, (results_count + RELEVANCE_MIN_CHUNK - 1) / RELEVANCE_MIN_CHUNK);
+
+	relevance_job_t jobs[nthreads];
+	pthread_t threads[nthreads];
+	bool started[nthreads];
+	const size_t chunk = (results_count + nthreads - 1) / nthreads;
+	for (size_t i = 0; i < nthreads; i++) {
+		jobs[i].pats = pats;
+		jobs[i].npats = npats;
+		jobs[i].start = MIN (i * chunk, results_count);
+		jobs[i].end = MIN (jobs[i].start + chunk, results_count);
+		/* the last chunk is scored by this thread */
+		started[i] = (i + 1 < nthreads
+				&& pthread_create (&threads[i], NULL, relevance_job, &jobs[i]) == 0);
+	}
+	for (size_t i = 0; i < nthreads; i++) {
+		if (!started[i]) {
+			relevance_job (&jobs[i]);
+		}
+	}
+	for (size_t i = 0; i < nthreads; i++) {
+		if (started[i]) {
+			pthread_join (threads[i], NULL);
+		}
 	}
+
+	for (size_t i = 0; i < npats; i++) {
+		strpat_free (pats[i]);
+	}
+	stats_end ();
 }
 
 void print_or_add_result (const void *pkg, pkgtype_t type)
 {
+	static unsigned int printed = 0;
 	if (config.sort == 0) {
-		print_package ("", pkg, (type == R_ALPM_PKG) ? alpm_pkg_get_str : aur_get_str);
+		if (!config.limit || printed++ < config.limit) {
+			print_package ("", pkg, (type == R_ALPM_PKG) ? alpm_pkg_get_str : aur_get_str);
+		}
 		return;
 	}
 
-	results = alpm_list_add (results, results_new (pkg, type));
+	results_add (pkg, type);
 }
 
-void show_results (void)
+void results_sort (void)
 {
-	if (!results) {
-		return;
+	stats_begin (ST_SORT, NULL);
+	if (results_heap ()) {
+		/* back to insertion order, for ties */
+		array_msort (results, results_count, sizeof (results_t), results_seq_cmp);
 	}
 
-	alpm_list_fn_cmp fn_cmp = NULL;
 	switch (config.sort) {
-		case S_NAME:  fn_cmp = results_cmp; break;
-		case S_VOTE:  fn_cmp = results_votes_cmp; break;
-		case S_POP:   fn_cmp = results_popularity_cmp; break;
-		case S_IDATE: fn_cmp = results_installdate_cmp; break;
-		case S_ISIZE: fn_cmp = results_isize_cmp; break;
-		case S_REL:   fn_cmp = results_relevance_cmp; break;
+		case S_NAME:
+			array_msort (results, results_count, sizeof (results_t), results_cmp);
+			break;
+		case S_VOTE:
+		case S_POP:
+		case S_IDATE:
+		case S_ISIZE:
+		case S_REL:
+			results_radix_sort ();
+			break;
 	}
-	if (fn_cmp) {
-		results = alpm_list_msort (results, alpm_list_count (results), fn_cmp);
+	stats_end ();
+}
+
+void show_results (void)
+{
+	if (!results_count) {
+		return;
 	}
 
-	const alpm_list_nav fn_nav = config.rsort ? alpm_list_previous : alpm_list_next;
-	const alpm_list_t *i_first = config.rsort ? alpm_list_last (results) : results;
+	const uint64_t probe_start = PROBE_START (show_results);
+	results_sort ();
 
-	for (const alpm_list_t *i = i_first; i; i = fn_nav (i)) {
-		const results_t *r = i->data;
-		if (r && r->type == R_ALPM_PKG) {
+	const size_t shown = (config.limit) ? MIN (config.limit, results_count) : results_count;
+	for (size_t i = 0; i < shown; i++) {
+		const results_t *r = &(results[config.rsort ? results_count - i - 1 : i]);
+		if (r->type == R_ALPM_PKG) {
 			print_package ("", r->ele, alpm_pkg_get_str);
-		} else if (r && r->type == R_AUR_PKG) {
+		} else if (r->type == R_AUR_PKG) {
 			print_package ("", r->ele, aur_get_str);
 		}
 	}
 
-	alpm_list_free_inner (results, (alpm_list_fn_free) results_free);
-	alpm_list_free (results);
-	results = NULL;
+	PROBE_DONE1 (show_results, probe_start, results_count);
+	results_free ();
 }
 
 target_t *target_parse (const char *str)
 {
+	const uint64_t probe_start = PROBE_START (target_parse);
 	target_t *ret = NULL;
 	char *c, *s = (char *) str;
 	MALLOC (ret, sizeof (target_t));
@@ -340,6 +531,7 @@ target_t *target_parse (const char *str)
 		ret->ver = NULL;
 	}
 	ret->name = (c) ? strndup (s, (c-s) / sizeof (char)) : strdup (s);
+	PROBE_DONE1 (target_parse, probe_start, ret->name);
 	return ret;
 }
 
@@ -392,11 +584,18 @@ int target_name_cmp (const target_t *t1, const char *name)
 	return strcmp (t1->name, name);
 }
 
+#define STRING_MIN_SIZE 64
+
 string_t *string_new (void)
+{
+	return string_new_size (STRING_MIN_SIZE);
+}
+
+string_t *string_new_size (size_t size)
 {
 	string_t *str;
 	MALLOC (str, sizeof (string_t));
-	str->size = PATH_MAX;
+	str->size = MAX (size + 1, STRING_MIN_SIZE);
 	MALLOC (str->s, str->size * sizeof (char));
 	return str;
 }
@@ -410,7 +609,7 @@ void string_free (string_t *dest)
 	FREE (dest);
 }
 
-static char *string_free2 (string_t *dest)
+char *string_free2 (string_t *dest)
 {
 	if (!dest) {
 		return NULL;
@@ -420,19 +619,26 @@ static char *string_free2 (string_t *dest)
 	return s;
 }
 
+void string_reserve (string_t *dest, size_t n)
+{
+	if (!dest || dest->size > dest->used + n) {
+		return;
+	}
+	while (dest->size <= dest->used + n) {
+		dest->size *= 2;
+	}
+	REALLOC (dest->s, dest->size * sizeof (char));
+}
+
 void string_ncat (string_t *dest, const char *src, size_t n)
 {
 	if (!dest || !src || !n) {
 		return;
 	}
-	if (dest->size <= dest->used + n) {
-		while (dest->size <= dest->used + n) {
-			dest->size *= 2;
-		}
-		REALLOC (dest->s, dest->size * sizeof (char));
-	}
+	string_reserve (dest, n);
+	memcpy (dest->s + dest->used, src, n);
 	dest->used += n;
-	strncat (dest->s, src, n);
+	dest->s[dest->used] = '\0';
 }
 
 void string_cat (string_t *dest, const char *src)
@@ -447,6 +653,143 @@ const char *string_cstr (const string_t *str)
 	return (const char *) (str ? (str->s ? str->s : "") : "");
 }
 
+/* Arena */
+#define ARENA_ALIGN sizeof (void *)
+#define RECORD_ARENA_SIZE 4096
+
+typedef struct _arena_block_t
+{
+	struct _arena_block_t *next;
+	size_t size;
+	size_t used;
+	char data[];
+} arena_block_t;
+
+struct _arena_t
+{
+	arena_block_t *head;
+};
+
+static arena_t *record_arena = NULL;
+
+static arena_block_t *arena_block_new (size_t size, arena_block_t *next)
+{
+	arena_block_t *b;
+	MALLOC (b, sizeof (arena_block_t) + size);
+	b->next = next;
+	b->size = size;
+	b->used = 0;
+	return b;
+}
+
+arena_t *arena_new (size_t size)
+{
+	arena_t *a;
+	MALLOC (a, sizeof (arena_t));
+	a->head = arena_block_new (size ? size : RECORD_ARENA_SIZE, NULL);
+	return a;
+}
+
+void *arena_alloc (arena_t *a, size_t n)
+{
+	arena_block_t *b = a->head;
+	const size_t start = (b->used + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	if (start + n > b->size) {
+		/* the new block is at least twice the previous one */
+		a->head = b = arena_block_new (MAX (n, b->size * 2), b);
+		b->used = n;
+		return b->data;
+	}
+	b->used = start + n;
+	return b->data + start;
+}
+
+char *arena_strndup (arena_t *a, const char *s, size_t n)
+{
+	char *ret = arena_alloc (a, n + 1);
+	memcpy (ret, s, n);
+	ret[n] = '\0';
+	return ret;
+}
+
+void arena_reset (arena_t *a)
+{
+	if (!a) {
+		return;
+	}
+	arena_block_t *b = a->head;
+	if (b->next) {
+		/* replace the chain with a single block big enough for all of it,
+		 * so that the next round doesn't need to grow again */
+		size_t size = 0;
+		while (b) {
+			arena_block_t *next = b->next;
+			size += b->size;
+			FREE (b);
+			b = next;
+		}
+		a->head = arena_block_new (size, NULL);
+	} else {
+		b->used = 0;
+	}
+}
+
+void arena_free (arena_t *a)
+{
+	if (!a) {
+		return;
+	}
+	arena_block_t *b = a->head;
+	while (b) {
+		arena_block_t *next = b->next;
+		FREE (b);
+		b = next;
+	}
+	FREE (a);
+}
+
+char *record_alloc (size_t n)
+{
+	if (!record_arena) {
+		record_arena = arena_new (RECORD_ARENA_SIZE);
+	}
+	return arena_alloc (record_arena, n);
+}
+
+char *record_strjoin (const char *s, ...)
+{
+	va_list ap;
+	size_t len = 0;
+	va_start (ap, s);
+	for (const char *i = s; i; i = va_arg (ap, const char *)) {
+		len += strlen (i);
+	}
+	va_end (ap);
+
+	char *ret = record_alloc (len + 1);
+	char *c = ret;
+	va_start (ap, s);
+	for (const char *i = s; i; i = va_arg (ap, const char *)) {
+		const size_t n = strlen (i);
+		memcpy (c, i, n);
+		c += n;
+	}
+	va_end (ap);
+	*c = '\0';
+	return ret;
+}
+
+void record_reset (void)
+{
+	arena_reset (record_arena);
+}
+
+void record_cleanup (void)
+{
+	arena_free (record_arena);
+	record_arena = NULL;
+}
+
 void strtrim (char *str)
 {
 	if (!str || *str == '\0') {
@@ -495,27 +838,117 @@ char *concat_str_list (const alpm_list_t *l)
 		return NULL;
 	}
 
-	len++; /* '\0' at the end */
-	char *ret;
-	CALLOC (ret, len, sizeof (char));
+	char *ret = record_alloc (len + 1); /* '\0' at the end */
+	char *c = ret;
 	for (const alpm_list_t *i = l; i; i = alpm_list_next (i)) {
 		if (i->data) {
-			if (i != l) strcat (ret, config.delimiter);
-			strcat (ret, i->data);
+			if (i != l) {
+				memcpy (c, config.delimiter, sep_len);
+				c += sep_len;
+			}
+			const size_t n = strlen (i->data);
+			memcpy (c, i->data, n);
+			c += n;
+		}
+	}
+	*c = '\0';
+
+	return ret;
+}
+
+char *concat_str_array (const char *const *a, size_t n)
+{
+	const size_t sep_len = strlen (config.delimiter);
+	size_t len = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		if (a[i]) {
+			/* data's len + space for separator for all entries but the 1st */
+			if (i) len += sep_len;
+			len += strlen (a[i]);
+		}
+	}
+
+	if (!len) {
+		return NULL;
+	}
+
+	char *ret = record_alloc (len + 1); /* '\0' at the end */
+	char *c = ret;
+	for (size_t i = 0; i < n; i++) {
+		if (a[i]) {
+			if (i) {
+				memcpy (c, config.delimiter, sep_len);
+				c += sep_len;
+			}
+			const size_t l = strlen (a[i]);
+			memcpy (c, a[i], l);
+			c += l;
 		}
 	}
+	*c = '\0';
 
 	return ret;
 }
 
+/* Same output as alpm_dep_compute_string(), written to buf if not NULL.
+ * Returns the string length.
+ */
+static size_t dep_to_buf (const alpm_depend_t *dep, char *buf)
+{
+	const char *name = dep->name ? dep->name : "";
+	const char *opr;
+	switch (dep->mod) {
+		case ALPM_DEP_MOD_GE: opr = ">="; break;
+		case ALPM_DEP_MOD_LE: opr = "<="; break;
+		case ALPM_DEP_MOD_EQ: opr = "="; break;
+		case ALPM_DEP_MOD_LT: opr = "<"; break;
+		case ALPM_DEP_MOD_GT: opr = ">"; break;
+		default: opr = ""; break;
+	}
+	const char *ver = (dep->mod != ALPM_DEP_MOD_ANY && dep->version) ? dep->version : "";
+	const char *parts[] = { name, opr, ver, dep->desc ? ": " : "", dep->desc ? dep->desc : "" };
+
+	size_t len = 0;
+	for (size_t i = 0; i < sizeof (parts) / sizeof (parts[0]); i++) {
+		const size_t n = strlen (parts[i]);
+		if (buf) {
+			memcpy (buf + len, parts[i], n);
+		}
+		len += n;
+	}
+	return len;
+}
+
 char *concat_dep_list (const alpm_list_t *deps)
 {
-	alpm_list_t *deps_str = NULL;
+	const size_t sep_len = strlen (config.delimiter);
+	size_t len = 0;
+
 	for (const alpm_list_t *i = deps; i; i = alpm_list_next (i)) {
-		deps_str = alpm_list_add (deps_str, alpm_dep_compute_string (i->data));
+		if (i->data) {
+			if (len) len += sep_len;
+			len += dep_to_buf (i->data, NULL);
+		}
 	}
-	char *ret = concat_str_list (deps_str);
-	FREELIST (deps_str);
+
+	if (!len) {
+		return NULL;
+	}
+
+	char *ret = record_alloc (len + 1);
+	char *c = ret;
+	for (const alpm_list_t *i = deps; i; i = alpm_list_next (i)) {
+		if (i->data) {
+			if (c != ret) {
+				memcpy (c, config.delimiter, sep_len);
+				c += sep_len;
+			}
+			c += dep_to_buf (i->data, c);
+		}
+	}
+	*c = '\0';
+
 	return ret;
 }
 
@@ -541,116 +974,182 @@ char *concat_file_list (const alpm_filelist_t *f)
 		return NULL;
 	}
 
-	len++; /* '\0' at the end */
-	char *ret;
-	CALLOC (ret, len, sizeof (char));
+	char *ret = record_alloc (len + 1); /* '\0' at the end */
+	char *c = ret;
 	for (size_t i = 0; i < f->count; i++) {
 		const alpm_file_t *file = f->files + i;
 		if (file && file->name) {
-			if (i != 0) strcat (ret, config.delimiter);
-			strcat (ret, file->name);
+			if (i != 0) {
+				memcpy (c, config.delimiter, sep_len);
+				c += sep_len;
+			}
+			const size_t n = strlen (file->name);
+			memcpy (c, file->name, n);
+			c += n;
 		}
 	}
+	*c = '\0';
 
 	return ret;
 }
 
 char *concat_backup_list (const alpm_list_t *backups)
 {
-	alpm_list_t *backups_str = NULL;
+	const size_t sep_len = strlen (config.delimiter);
+	size_t len = 0;
+
 	for (const alpm_list_t *i = backups; i; i = alpm_list_next (i)) {
 		const alpm_backup_t *backup = i->data;
-		if (backup) {
-			char *b_str;
-			int ret = asprintf (&b_str, "%s\t%s", backup->name, backup->hash);
-			if (!b_str || ret < 0) {
-				continue;
+		if (backup && backup->name && backup->hash) {
+			/* "name\thash" */
+			if (len) len += sep_len;
+			len += strlen (backup->name) + 1 + strlen (backup->hash);
+		}
+	}
+
+	if (!len) {
+		return NULL;
+	}
+
+	char *ret = record_alloc (len + 1);
+	char *c = ret;
+	for (const alpm_list_t *i = backups; i; i = alpm_list_next (i)) {
+		const alpm_backup_t *backup = i->data;
+		if (backup && backup->name && backup->hash) {
+			if (c != ret) {
+				memcpy (c, config.delimiter, sep_len);
+				c += sep_len;
 			}
-			backups_str = alpm_list_add (backups_str, b_str);
+			const size_t name_len = strlen (backup->name);
+			const size_t hash_len = strlen (backup->hash);
+			memcpy (c, backup->name, name_len);
+			c += name_len;
+			*c++ = '\t';
+			memcpy (c, backup->hash, hash_len);
+			c += hash_len;
 		}
 	}
-	char *ret = concat_str_list (backups_str);
-	FREELIST (backups_str);
+	*c = '\0';
+
 	return ret;
 }
 
+size_t write_file_list (const alpm_filelist_t *f, writefn w, void *ctx)
+{
+	if (!f) {
+		return 0;
+	}
+
+	const size_t sep_len = strlen (config.delimiter);
+	size_t written = 0;
+	for (size_t i = 0; i < f->count; i++) {
+		const alpm_file_t *file = f->files + i;
+		if (file && file->name) {
+			if (written++) {
+				w (ctx, config.delimiter, sep_len);
+			}
+			w (ctx, file->name, strlen (file->name));
+		}
+	}
+	return written;
+}
+
+size_t write_backup_list (const alpm_list_t *backups, writefn w, void *ctx)
+{
+	const size_t sep_len = strlen (config.delimiter);
+	size_t written = 0;
+	for (const alpm_list_t *i = backups; i; i = alpm_list_next (i)) {
+		const alpm_backup_t *backup = i->data;
+		if (backup && backup->name && backup->hash) {
+			if (written++) {
+				w (ctx, config.delimiter, sep_len);
+			}
+			w (ctx, backup->name, strlen (backup->name));
+			w (ctx, "\t", 1);
+			w (ctx, backup->hash, strlen (backup->hash));
+		}
+	}
+	return written;
+}
+
 void format_str (char *s)
 {
-	char *c = s;
-	while ((c = strchr (c, '\\'))) {
-		bool mod = true;
-		switch (c[1]) {
-			case '\\': c[0] = '\\'; break;
-			case 'e': c[0] = '\033'; break;
-			case 'n': c[0] = '\n'; break;
-			case 'r': c[0] = '\r'; break;
-			case 't': c[0] = '\t'; break;
-			default: mod = false; break;
+	/* in place, the string can only shrink */
+	char *w = s;
+	for (const char *c = s; *c; c++) {
+		char esc = '\0';
+		if (c[0] == '\\') {
+			switch (c[1]) {
+				case '\\': esc = '\\'; break;
+				case 'e': esc = '\033'; break;
+				case 'n': esc = '\n'; break;
+				case 'r': esc = '\r'; break;
+				case 't': esc = '\t'; break;
+			}
 		}
-		if (mod) {
-			memcpy (&(c[1]), &(c[2]), (strlen (&(c[2]))+1) * sizeof (char));
+		if (esc) {
+			*w++ = esc;
+			c++;
+		} else {
+			*w++ = *c;
 		}
-		c++;
 	}
+	*w = '\0';
 }
 
-static void print_escape (const char *str)
+static void print_escape (const char *str, size_t n)
 {
-	const char *c = str;
-	if (!c) {
+	if (!str) {
 		return;
 	}
-	while (*c != '\0') {
+	for (const char *c = str; c < str + n; c++) {
 		if (*c == '"') {
 			putchar ('\\');
 		}
 		putchar (*c);
-		c++;
 	}
 }
 
-char *itostr (int i)
+/* Format an integer in the record arena, without going through printf */
+static char *record_numtostr (unsigned long long v, bool neg)
 {
-	char *is;
-	int ret = asprintf (&is, "%d", i);
-	if (ret < 0) {
-		FREE (is);
+	char buf[24];
+	char *c = &(buf[sizeof (buf)]);
+	do {
+		*--c = '0' + (v % 10);
+		v /= 10;
+	} while (v);
+	if (neg) {
+		*--c = '-';
 	}
-	return is;
+	const size_t len = &(buf[sizeof (buf)]) - c;
+	char *ret = record_alloc (len + 1);
+	memcpy (ret, c, len);
+	ret[len] = '\0';
+	return ret;
 }
 
-char *ltostr (long i)
+static char *lltostr (long long i)
 {
-	char *is;
-	int ret = asprintf (&is, "%ld", i);
-	if (ret < 0) {
-		FREE (is);
-	}
-	return is;
+	return (i < 0)
+		? record_numtostr (-(unsigned long long) i, true)
+		: record_numtostr ((unsigned long long) i, false);
 }
 
-char *ttostr (time_t t)
+char *itostr (int i)
 {
-	char *ts;
-	CALLOC (ts, 11, sizeof (char));
-	strftime (ts, 11, "%s", localtime (&t));
-	return ts;
+	return lltostr (i);
 }
 
-/* Helper function for strreplace */
-static void _strnadd (char **str, const char *append, size_t count)
+char *ltostr (long i)
 {
-	if (!str) {
-		return;
-	}
-
-	if (*str) {
-		REALLOC (*str, strlen (*str) + count + 1);
-	} else {
-		CALLOC (*str, sizeof (char), count + 1);
-	}
+	return lltostr (i);
+}
 
-	strncat (*str, append, count);
+char *ttostr (time_t t)
+{
+	/* same as strftime ("%s"): seconds since the Epoch */
+	return lltostr ((long long) t);
 }
 
 /* Replace all occurances of 'needle' with 'replace' in 'str', returning
@@ -658,28 +1157,60 @@ static void _strnadd (char **str, const char *append, size_t count)
 char *strreplace (const char *str, const char *needle, const char *replace)
 {
 	const char *p = str, *q = str;
-	char *newstr = NULL;
 	const size_t needlesz = strlen (needle), replacesz = strlen (replace);
+	string_t *newstr = string_new_size (strlen (str));
 
 	while (true) {
 		q = strstr (p, needle);
 		if (!q) { /* not found */
-			if (*p) {
-				/* add the rest of 'p' */
-				_strnadd (&newstr, p, strlen (p));
-			}
+			/* add the rest of 'p' */
+			string_cat (newstr, p);
 			break;
 		} else { /* found match */
-			if (q > p) {
-				/* add chars between this occurance and last occurance, if any */
-				_strnadd (&newstr, p, q - p);
-			}
-			_strnadd (&newstr, replace, replacesz);
+			/* add chars between this occurance and last occurance, if any */
+			string_ncat (newstr, p, q - p);
+			string_ncat (newstr, replace, replacesz);
 			p = q + needlesz;
 		}
 	}
 
-	return newstr;
+	if (!newstr->used) {
+		string_free (newstr);
+		return NULL;
+	}
+	return string_free2 (newstr);
+}
+
+void array_msort (void *base, size_t n, size_t size, alpm_list_fn_cmp cmp)
+{
+	if (n < 2) {
+		return;
+	}
+	char *tmp;
+	MALLOC (tmp, n * size);
+	char *src = base, *dst = tmp;
+	/* bottom-up merge of runs of width w */
+	for (size_t w = 1; w < n; w *= 2) {
+		for (size_t lo = 0; lo < n; lo += 2 * w) {
+			const size_t mid = MIN (lo + w, n), hi = MIN (lo + 2 * w, n);
+			size_t i = lo, j = mid, k = lo;
+			while (i < mid && j < hi) {
+				/* take from the left run on ties to keep the sort stable */
+				const size_t from = (cmp (src + j * size, src + i * size) < 0) ? j++ : i++;
+				memcpy (dst + k++ * size, src + from * size, size);
+			}
+			memcpy (dst + k * size, src + i * size, (mid - i) * size);
+			k += mid - i;
+			memcpy (dst + k * size, src + j * size, (hi - j) * size);
+		}
+		char *t = src;
+		src = dst;
+		dst = t;
+	}
+	if (src != base) {
+		memcpy (base, src, n * size);
+	}
+	FREE (tmp);
 }
 
 /** Parse the basename of a program from a path.
@@ -857,8 +1388,7 @@ static void color_print_package (const void *p, printpkgfn f)
 	 *   C_VER otherwise
 	 */
 	const char *lver = alpm_local_pkg_get_str (info, 'l');
-	info = f (p, (config.aur_upgrades || config.filter & F_UPGRADES) ? 'V' : 'v');
-	char *ver = STRDUP (info);
+	const char *ver = f (p, (config.aur_upgrades || config.filter & F_UPGRADES) ? 'V' : 'v');
 	info = (aur) ? f (p, 'm') : NULL;
 	if (config.aur_foreign) {
 		/* Compare foreign package with AUR */
@@ -867,7 +1397,6 @@ static void color_print_package (const void *p, printpkgfn f)
 		} else {
 			printf (" %s%s%s\n", color(C_VER), lver, color(C_NO));
 		}
-		free (ver);
 		return;
 	}
 
@@ -889,7 +1418,6 @@ static void color_print_package (const void *p, printpkgfn f)
 
 	if (config.aur_upgrades || config.filter & F_UPGRADES) {
 		printf ("\n");
-		free (ver);
 		return;
 	}
 
@@ -899,9 +1427,6 @@ static void color_print_package (const void *p, printpkgfn f)
 	/* show install information */
 	color_print_install_info (p, f, lver, ver);
 
-	/* ver no more needed */
-	free (ver);
-
 	/* Out of date status & votes */
 	if (aur) {
 		color_print_aur_status (p, f);
@@ -921,48 +1446,285 @@ static void color_print_package (const void *p, printpkgfn f)
 	printf ("%s", color(C_NO));
 }
 
-void print_package (const char *target, const void *pkg, printpkgfn f)
+static void json_print_cb (void *ctx, const char *s, size_t n)
 {
-	if (config.quiet || !target || !pkg || !f) {
+	fwrite (s, sizeof (char), n, stdout);
+}
+
+void json_open (void)
+{
+	if (json_out) {
 		return;
 	}
+	json_out = yajl_gen_alloc (NULL);
+	if (!json_out) {
+		perror ("yajl_gen");
+		exit (1);
+	}
+	yajl_gen_config (json_out, yajl_gen_print_callback, json_print_cb, NULL);
+	if (!config.json_lines) {
+		yajl_gen_array_open (json_out);
+	}
+}
 
-	if (!config.custom_out) {
-		color_print_package (pkg, f);
+void json_close (void)
+{
+	if (!json_out) {
 		return;
 	}
+	if (!config.json_lines) {
+		yajl_gen_array_close (json_out);
+		putchar ('\n');
+	}
+	yajl_gen_free (json_out);
+	json_out = NULL;
+}
+
+void json_gen_key (yajl_gen g, const char *key)
+{
+	yajl_gen_string (g, (const unsigned char *) key, strlen (key));
+}
 
-	char *s = pkg_to_str (target, pkg, f, config.format_out);
-	if (!s) {
+static void json_gen_value (yajl_gen g, const char *val)
+{
+	if (val) {
+		yajl_gen_string (g, (const unsigned char *) val, strlen (val));
+	} else {
+		yajl_gen_null (g);
+	}
+}
+
+void json_gen_str (yajl_gen g, const char *key, const char *val)
+{
+	json_gen_key (g, key);
+	json_gen_value (g, val);
+}
+
+void json_gen_int (yajl_gen g, const char *key, long long val)
+{
+	json_gen_key (g, key);
+	yajl_gen_integer (g, val);
+}
+
+void json_gen_double (yajl_gen g, const char *key, double val)
+{
+	json_gen_key (g, key);
+	/* JSON has no NaN nor infinity */
+	if (!isfinite (val)) {
+		yajl_gen_null (g);
 		return;
 	}
+	/* yajl_gen_double() follows LC_NUMERIC, JSON doesn't.
+	 * 17 significant digits give the same double back. */
+	char buf[64];
+	const int len = snprintf (buf, sizeof (buf), "%.17g", val);
+	for (char *c = buf; *c; c++) {
+		if (*c == ',') *c = '.';
+	}
+	yajl_gen_number (g, buf, len);
+}
 
+void json_gen_bool (yajl_gen g, const char *key, bool val)
+{
+	json_gen_key (g, key);
+	yajl_gen_bool (g, val);
+}
+
+void json_gen_str_list (yajl_gen g, const char *key, const alpm_list_t *l)
+{
+	json_gen_key (g, key);
+	yajl_gen_array_open (g);
+	for (const alpm_list_t *i = l; i; i = alpm_list_next (i)) {
+		if (i->data) {
+			json_gen_value (g, i->data);
+		}
+	}
+	yajl_gen_array_close (g);
+}
+
+void json_gen_str_array (yajl_gen g, const char *key, const char *const *a, size_t n)
+{
+	json_gen_key (g, key);
+	yajl_gen_array_open (g);
+	for (size_t i = 0; i < n; i++) {
+		if (a[i]) {
+			json_gen_value (g, a[i]);
+		}
+	}
+	yajl_gen_array_close (g);
+}
+
+void json_gen_dep_list (yajl_gen g, const char *key, const alpm_list_t *deps)
+{
+	json_gen_key (g, key);
+	yajl_gen_array_open (g);
+	for (const alpm_list_t *i = deps; i; i = alpm_list_next (i)) {
+		if (i->data) {
+			const size_t len = dep_to_buf (i->data, NULL);
+			char *dep = record_alloc (len);
+			dep_to_buf (i->data, dep);
+			yajl_gen_string (g, (const unsigned char *) dep, len);
+		}
+	}
+	yajl_gen_array_close (g);
+}
+
+void json_gen_file_list (yajl_gen g, const char *key, const alpm_filelist_t *f)
+{
+	json_gen_key (g, key);
+	yajl_gen_array_open (g);
+	for (size_t i = 0; f && i < f->count; i++) {
+		const alpm_file_t *file = f->files + i;
+		if (file && file->name) {
+			json_gen_value (g, file->name);
+		}
+	}
+	yajl_gen_array_close (g);
+}
+
+void json_gen_backup_list (yajl_gen g, const char *key, const alpm_list_t *backups)
+{
+	json_gen_key (g, key);
+	yajl_gen_array_open (g);
+	for (const alpm_list_t *i = backups; i; i = alpm_list_next (i)) {
+		const alpm_backup_t *backup = i->data;
+		if (backup) {
+			yajl_gen_map_open (g);
+			json_gen_str (g, "name", backup->name);
+			json_gen_str (g, "hash", backup->hash);
+			yajl_gen_map_close (g);
+		}
+	}
+	yajl_gen_array_close (g);
+}
+
+static void json_print_package (const char *target, const void *pkg, printpkgfn f)
+{
+	json_open ();
+	yajl_gen_map_open (json_out);
+	if (target[0] != '\0') {
+		json_gen_str (json_out, "target", target);
+	}
+	if (f == alpm_pkg_get_str) {
+		alpm_pkg_json (json_out, (alpm_pkg_t *) pkg);
+	} else if (f == aur_get_str) {
+		aur_pkg_json (json_out, (const aurpkg_t *) pkg);
+	} else {
+		json_gen_str (json_out, "name", f (pkg, 'n'));
+	}
+	if (f != alpm_grp_get_str) {
+		json_gen_str (json_out, "local_version", alpm_local_pkg_get_str (f (pkg, 'n'), 'l'));
+	}
+	yajl_gen_map_close (json_out);
+	if (config.json_lines) {
+		yajl_gen_reset (json_out, "\n");
+	}
+}
+
+static void stdout_write (void *ctx, const char *s, size_t n)
+{
 	if (config.escape) {
-		print_escape (s);
+		print_escape (s, n);
 	} else {
-		printf ("%s\n", s);
+		fwrite (s, sizeof (char), n, stdout);
+	}
+}
+
+static void string_write (void *ctx, const char *s, size_t n)
+{
+	string_ncat ((string_t *) ctx, s, n);
+}
+
+static void print_package_out (const char *target, const void *pkg, printpkgfn f)
+{
+	/* field strings of the previous package are no more needed */
+	record_reset ();
+
+	if (config.json) {
+		json_print_package (target, pkg, f);
+		return;
+	}
+
+	if (!config.custom_out) {
+		color_print_package (pkg, f);
+		return;
+	}
+
+	if (!config.format_out) {
+		return;
+	}
+
+	pkg_write (target, pkg, f, config.format_out, stdout_write, NULL);
+	if (!config.escape) {
+		putchar ('\n');
 	}
-	free (s);
 	fflush (NULL);
 }
 
-char *pkg_to_str (const char *target, const void *pkg, printpkgfn f, const char *format)
+void print_package (const char *target, const void *pkg, printpkgfn f)
 {
-	if (!format) {
-		return NULL;
+	if (config.quiet || !target || !pkg || !f) {
+		return;
+	}
+
+	const uint64_t probe_start = PROBE_START (print_package);
+	stats_begin (ST_OUTPUT, NULL);
+	print_package_out (target, pkg, f);
+	stats_end ();
+	stats_count (SC_RESULTS, 1);
+	PROBE_DONE1 (print_package, probe_start, f (pkg, 'n'));
+}
+
+/* List fields which may be huge are streamed to the writer instead of
+ * being joined in memory first.
+ * Returns false if c is not such a field.
+ */
+static bool pkg_write_list (const void *pkg, printpkgfn f, unsigned char c, writefn w, void *ctx)
+{
+	size_t written = 0;
+	switch (c) {
+		case 'F':
+			{
+				const char *name = f (pkg, 'n');
+				alpm_pkg_t *lpkg = (name)
+					? alpm_db_get_pkg (alpm_get_localdb (config.handle), name)
+					: NULL;
+				if (lpkg) {
+					written = write_file_list (alpm_pkg_get_files (lpkg), w, ctx);
+				}
+			}
+			break;
+		case 'B':
+			if (f != alpm_pkg_get_str) {
+				return false;
+			}
+			written = write_backup_list (alpm_pkg_get_backup ((alpm_pkg_t *) pkg), w, ctx);
+			break;
+		default:
+			return false;
+	}
+	if (!written) {
+		w (ctx, "-", 1);
 	}
+	return true;
+}
+
+void pkg_write (const char *target, const void *pkg, printpkgfn f, const char *format,
+                writefn w, void *ctx)
+{
 	const char *c;
-	string_t *ret = string_new ();
 	const char *ptr = format;
 	const char *end = &(format[strlen(format)]);
 	while ((c = strchr (ptr, '%'))) {
 		if (&(c[1]) == end) {
 			break;
 		}
+		if (c != ptr) {
+			w (ctx, ptr, (c-ptr));
+		}
 		if (c[1] == '%') {
-			string_ncat (ret, ptr, (c-ptr));
-			string_cat (ret, "%%");
-		} else {
+			w (ctx, "%%", 2);
+		} else if (!pkg_write_list (pkg, f, c[1], w, ctx)) {
 			const char *info = NULL;
 			if (strchr (FORMAT_LOCAL_PKG, c[1])) {
 				info = alpm_local_pkg_get_str (f (pkg, 'n'), c[1]);
@@ -971,20 +1733,27 @@ char *pkg_to_str (const char *target, const void *pkg, printpkgfn f, const char
 			} else {
 				info = f (pkg, c[1]);
 			}
-			if (c != ptr) {
-				string_ncat (ret, ptr, (c-ptr));
-			}
 			if (info) {
-				string_cat (ret, info);
+				w (ctx, info, strlen (info));
 			} else {
-				string_cat (ret, "-");
+				w (ctx, "-", 1);
 			}
 		}
 		ptr = &(c[2]);
 	}
 	if (ptr != end) {
-		string_ncat (ret, ptr, (end - ptr));
+		w (ctx, ptr, (end - ptr));
 	}
+}
+
+char *pkg_to_str (const char *target, const void *pkg, printpkgfn f, const char *format)
+{
+	if (!format) {
+		return NULL;
+	}
+	record_reset ();
+	string_t *ret = string_new_size (strlen (format));
+	pkg_write (target, pkg, f, format, string_write, ret);
 	return string_free2 (ret);
 }
 
@@ -1028,17 +1797,67 @@ static void target_arg_free (target_arg_t *t)
 	}
 }
 
-alpm_list_t *target_arg_clear (const target_arg_t *t, alpm_list_t *targets)
+typedef struct _argcount_t
+{
+	const char *s;
+	size_t count;
+} argcount_t;
+
+static argcount_t *argcount_slot (argcount_t *table, size_t mask, const char *s)
 {
-	if (t && targets && config.just_one) {
+	/* FNV-1a */
+	size_t h = 2166136261u;
+	for (const unsigned char *c = (const unsigned char *) s; *c; c++) {
+		h = (h ^ *c) * 16777619u;
+	}
+	h &= mask;
+	while (table[h].s && strcmp (table[h].s, s) != 0) {
+		h = (h + 1) & mask;
+	}
+	return &(table[h]);
+}
+
+/*
+ * Each arg removes one target equal to it. Args are counted in a hash
+ * table, then targets are filtered in a single pass: with many targets,
+ * removing them one by one from the list was quadratic.
+ * Args are consumed, they may point to the removed targets.
+ */
+alpm_list_t *target_arg_clear (target_arg_t *t, alpm_list_t *targets)
+{
+	if (!t || !t->args || !config.just_one) {
+		return targets;
+	}
+	if (targets) {
+		size_t size = 16;
+		while (size < 2 * alpm_list_count (t->args)) {
+			size *= 2;
+		}
+		argcount_t *table;
+		CALLOC (table, size, sizeof (argcount_t));
 		for (const alpm_list_t *i = t->args; i; i = alpm_list_next (i)) {
-			char *data = NULL;
-			targets = alpm_list_remove_str (targets, i->data, &data);
-			if (data) {
-				free (data);
+			argcount_t *slot = argcount_slot (table, size - 1, i->data);
+			slot->s = i->data;
+			slot->count++;
+		}
+		alpm_list_t *kept = NULL, *removed = NULL;
+		for (const alpm_list_t *i = targets; i; i = alpm_list_next (i)) {
+			argcount_t *slot = argcount_slot (table, size - 1, i->data);
+			if (slot->count) {
+				slot->count--;
+				removed = alpm_list_add (removed, i->data);
+			} else {
+				kept = alpm_list_add (kept, i->data);
 			}
 		}
-	}
+		alpm_list_free (targets);
+		targets = kept;
+		/* freed last, the table keys may be among them */
+		FREE (table);
+		FREELIST (removed);
+	}
+	alpm_list_free (t->args);
+	t->args = NULL;
 	return targets;
 }
 
@@ -1125,15 +1944,29 @@ char *curl_fetch (CURL *curl, const char *url)
 	curl_easy_setopt (curl, CURLOPT_WRITEDATA, res);
 	curl_easy_setopt (curl, CURLOPT_URL, url);
 
+	const uint64_t probe_start = PROBE_START (curl_fetch);
 	CURLcode curl_code;
-	if ((curl_code = curl_easy_perform (curl)) != CURLE_OK) {
+	long http_code = 0;
+	stats_begin (ST_CURL, NULL);
+	stats_note (url);
+	if (replay_serving ()) {
+		curl_code = replay_fetch (url, res, &http_code);
+	} else {
+		curl_code = curl_easy_perform (curl);
+		curl_easy_getinfo (curl, CURLINFO_RESPONSE_CODE, &http_code);
+	}
+	stats_end ();
+	PROBE_DONE2 (curl_fetch, probe_start, url, (int) curl_code);
+	if (!replay_serving ()) {
+		netstats_add (curl, url, curl_code);
+		replay_save (curl, url, curl_code, http_code, res);
+	}
+	if (curl_code != CURLE_OK) {
 		fprintf(stderr, "curl error: %s\n", curl_easy_strerror (curl_code));
 		string_free (res);
 		return NULL;
 	}
 
-	long http_code;
-	curl_easy_getinfo (curl, CURLINFO_RESPONSE_CODE, &http_code);
 	if (http_code != 200) {
 		fprintf(stderr, "The URL %s returned error : %ld\n", url, http_code);
 		string_free (res);
@@ -24,6 +24,7 @@
 #include <alpm_list.h>
 #include <curl/curl.h>
 #include <curl/easy.h>
+#include <yajl/yajl_gen.h>
 #include "aur.h"
 
 #if defined(HAVE_GETTEXT) && defined(ENABLE_NLS)
@@ -33,6 +34,23 @@
 #define _(x) x
 #endif
 
+#ifdef ENABLE_ALLOC_STATS
+#include "allocstats.h"
+#define STRDUP(s) (s) ? alloc_strdup (s, __FILE__, __LINE__) : NULL
+#define CALLOC(p, l, s) do { \
+    if ((p = alloc_calloc (l, s, __FILE__, __LINE__)) == NULL) { \
+      perror ("calloc"); \
+      exit (1); \
+    } \
+  } while (0)
+#define REALLOC(p, s) do { \
+    if ((p = alloc_realloc (p, s, __FILE__, __LINE__)) == NULL) { \
+      perror ("realloc"); \
+      exit (1); \
+    } \
+  } while (0)
+#define FREE(p) do { alloc_free (p); p = NULL; } while (0)
+#else
 #define STRDUP(s) (s) ? strdup (s) : NULL
 #define CALLOC(p, l, s) do { \
     if ((p = calloc (l, s)) == NULL) { \
@@ -40,7 +58,6 @@
       exit (1); \
     } \
   } while (0)
-#define MALLOC(p, s) CALLOC (p, 1, s)
 #define REALLOC(p, s) do { \
     if ((p = realloc (p, s)) == NULL) { \
       perror ("realloc"); \
@@ -48,6 +65,8 @@
     } \
   } while (0)
 #define FREE(p) do { free (p); p = NULL; } while (0)
+#endif
+#define MALLOC(p, s) CALLOC (p, 1, s)
 
 
 
@@ -110,6 +129,7 @@ typedef struct _aq_config
 {
 	char *arch;
 	char *aur_url;
+	char *arch_url;
 	char *configfile;
 	char *dbpath;
 	char *format_out;
@@ -130,7 +150,10 @@ typedef struct _aq_config
 	bool get_res;
 	bool insecure;
 	bool is_file;
+	bool json;
+	bool json_lines;
 	bool just_one;
+	unsigned int limit;
 	bool list;
 	bool name_only;
 	bool numbering;
@@ -185,7 +208,7 @@ target_arg_t *target_arg_init (ta_dup_fn dup_fn,
                                alpm_list_fn_cmp cmp_fn,
                                alpm_list_fn_free free_fn);
 bool target_arg_add (target_arg_t *t, const char *s, void *item);
-alpm_list_t *target_arg_clear (const target_arg_t *t, alpm_list_t *targets);
+alpm_list_t *target_arg_clear (target_arg_t *t, alpm_list_t *targets);
 alpm_list_t *target_arg_close (target_arg_t *t, alpm_list_t *targets);
 
 /*
@@ -199,7 +222,12 @@ typedef struct _string_t
 } string_t;
 
 string_t *string_new (void);
+/* size: number of chars expected, to avoid growing the buffer */
+string_t *string_new_size (size_t size);
 void string_free (string_t *dest);
+/* string_free2() frees dest but returns its buffer (to be free'd) */
+char *string_free2 (string_t *dest);
+void string_reserve (string_t *dest, size_t n);
 void string_ncat (string_t *dest, const char *src, size_t n);
 void string_cat (string_t *dest, const char *src);
 const char *string_cstr (const string_t *str);
@@ -207,16 +235,52 @@ const char *string_cstr (const string_t *str);
 void strtrim (char *str);
 char *strreplace (const char *str, const char *needle, const char *replace);
 
+/*
+ * Arena allocator
+ * Memory is handed out by bumping a pointer and released all at once.
+ */
+typedef struct _arena_t arena_t;
+
+arena_t *arena_new (size_t size);
+void *arena_alloc (arena_t *a, size_t n);
+char *arena_strndup (arena_t *a, const char *s, size_t n);
+void arena_reset (arena_t *a);
+void arena_free (arena_t *a);
+
+/*
+ * Per-record arena
+ * Field strings built by the *_get_str() getters live here until the
+ * next record_reset(), which is called once per rendered package.
+ * They should not be passed to free.
+ */
+char *record_alloc (size_t n);
+/* Join a NULL terminated list of strings */
+char *record_strjoin (const char *s, ...);
+void record_reset (void);
+void record_cleanup (void);
+
+/* lists to string, allocated in the record arena */
 char *concat_str_list (const alpm_list_t *l);
+char *concat_str_array (const char *const *a, size_t n);
 char *concat_dep_list (const alpm_list_t *deps);
 char *concat_file_list (const alpm_filelist_t *f);
 char *concat_backup_list (const alpm_list_t *backups);
 
-/* integer/long to string */
+/*
+ * Output writer
+ * Used to stream output without building it in memory first.
+ */
+typedef void (*writefn)(void *ctx, const char *s, size_t n);
+
+/* lists to writer, returns the number of entries written */
+size_t write_file_list (const alpm_filelist_t *f, writefn w, void *ctx);
+size_t write_backup_list (const alpm_list_t *backups, writefn w, void *ctx);
+
+/* integer/long to string, allocated in the record arena */
 char *itostr (int i);
 char *ltostr (long i);
 
-/* time to string */
+/* time to string, allocated in the record arena */
 char *ttostr (time_t t);
 
 /*
@@ -225,14 +289,49 @@ char *ttostr (time_t t);
 typedef const char *(*printpkgfn)(const void *, unsigned char);
 void format_str (char *s);
 char *pkg_to_str (const char *target, const void *pkg, printpkgfn f, const char *format);
+/* pkg_write() is pkg_to_str() sending its output to w */
+void pkg_write (const char *target, const void *pkg, printpkgfn f, const char *format,
+                writefn w, void *ctx);
 void print_package (const char *target, const void *pkg, printpkgfn f);
 
+/*
+ * JSON output
+ * json_open() starts the output stream, json_close() ends it.
+ * json_gen_*() add a "key": value pair to the current object.
+ */
+void json_open (void);
+void json_close (void);
+/* json_gen_key() adds a key alone, to be followed by a map or an array */
+void json_gen_key (yajl_gen g, const char *key);
+void json_gen_str (yajl_gen g, const char *key, const char *val);
+void json_gen_int (yajl_gen g, const char *key, long long val);
+void json_gen_double (yajl_gen g, const char *key, double val);
+void json_gen_bool (yajl_gen g, const char *key, bool val);
+void json_gen_str_list (yajl_gen g, const char *key, const alpm_list_t *l);
+void json_gen_str_array (yajl_gen g, const char *key, const char *const *a, size_t n);
+void json_gen_dep_list (yajl_gen g, const char *key, const alpm_list_t *deps);
+void json_gen_file_list (yajl_gen g, const char *key, const alpm_filelist_t *f);
+void json_gen_backup_list (yajl_gen g, const char *key, const alpm_list_t *backups);
+
 /* Results */
 void calculate_results_relevance (const alpm_list_t *targets);
 void print_or_add_result (const void *pkg, pkgtype_t type);
+/* results_own_arena() hands over the arena of the AUR packages about to
+ * be passed to print_or_add_result(), results_release_arena() is called
+ * once they are. The arena is freed when no result points to it anymore:
+ * at once if none was kept, or when the last one is pushed out of the
+ * --limit heap, at the latest by results_free() */
+void results_own_arena (arena_t *a);
+void results_release_arena (void);
+/* results_sort() sorts the results by config.sort, show_results()
+ * sorts and prints them, then frees them */
+void results_sort (void);
+void results_free (void);
 void show_results (void);
 
 /* Utils */
+/* array_msort() is a stable merge sort of n elements of size bytes */
+void array_msort (void *base, size_t n, size_t size, alpm_list_fn_cmp cmp);
 /* mbasename is from pacman's code */
 const char *mbasename (const char *path);
 